@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "io/async_io.h"
+
+/*
+ * Throughput of reading a regular file and a pipe, newlines being counted to
+ * touch the data: using blocking reads, and each asynchronous backend.
+ */
+
+#define REPEAT 3
+#define BUFFER_SIZE (1 << 16)
+#define WRITE_SIZE 4096 // Same as a typical producer using stdio
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t count_lines(const char *data, size_t len)
+{
+    size_t ret = 0;
+
+    for (const char *it = data; (it = memchr(it, '\n', data + len - it));)
+    {
+        ret += 1;
+        it += 1;
+    }
+
+    return ret;
+}
+
+/*
+ * Returns the number of lines, or 0 if the backend is not available.
+ */
+static size_t read_all(int fd, int backend)
+{
+    size_t ret = 0;
+
+    if (backend < 0)
+    {
+        static char buf[BUFFER_SIZE];
+        ssize_t res;
+
+        while ((res = read(fd, buf, sizeof(buf))) > 0)
+            ret += count_lines(buf, res);
+        return ret;
+    }
+
+    struct async_io *io = make_async_io(fd, STDOUT_FILENO, backend);
+    const char *data = NULL;
+    size_t len = 0;
+
+    if (io == NULL)
+        return 0;
+
+    while ((data = async_read(io, &len)) != NULL)
+        ret += count_lines(data, len);
+
+    return destroy_async_io(io) ? ret : 0;
+}
+
+static void produce(int fd, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len;)
+    {
+        size_t size = len - i < WRITE_SIZE ? len - i : WRITE_SIZE;
+        ssize_t res = write(fd, data + i, size);
+
+        if (res < 0)
+            exit(1);
+        i += res;
+    }
+
+    exit(0);
+}
+
+static size_t run(FILE *file, const char *data, size_t len, int backend)
+{
+    if (file)
+    {
+        rewind(file);
+        return read_all(fileno(file), backend);
+    }
+
+    int fds[2];
+    if (pipe(fds))
+        return 0;
+
+    fflush(stdout); // Do not duplicate our buffered output in the child
+
+    pid_t producer = fork();
+    if (producer == 0)
+    {
+        close(fds[0]);
+        produce(fds[1], data, len);
+    }
+    close(fds[1]);
+
+    size_t ret = read_all(fds[0], backend);
+    close(fds[0]);
+
+    int status = 1;
+    if (producer < 0 || waitpid(producer, &status, 0) < 0 || status != 0)
+        ret = 0;
+
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct
+    {
+        const char *name;
+        int backend;
+    } modes[] = {
+        { "blocking", -1 },
+        { "epoll", IO_EPOLL },
+        { "uring", IO_URING },
+    };
+    size_t len = argc > 1 ? strtoul(argv[1], NULL, 10) : 256 << 20;
+    char *data = malloc(len);
+    FILE *file = tmpfile();
+
+    if (data == NULL || file == NULL)
+        return 1;
+
+    for (size_t i = 0; i < len; ++i)
+        data[i] = "1 + 2 * 3\n"[i % 10];
+    if (fwrite(data, 1, len, file) != len || fflush(file))
+        return 1;
+
+    printf("%zu bytes\n", len);
+
+    for (int f = 0; f < 2; ++f)
+    {
+        printf("    %s\n", f ? "pipe" : "file");
+
+        for (size_t m = 0; m < sizeof(modes) / sizeof(*modes); ++m)
+        {
+            double best = 0;
+            for (int i = 0; i < REPEAT; ++i)
+            {
+                double start = now();
+                FILE *in = f ? NULL : file;
+                size_t lines = run(in, data, len, modes[m].backend);
+                double elapsed = now() - start;
+
+                if (lines != len / 10)
+                {
+                    best = 0;
+                    break;
+                }
+                if (i == 0 || elapsed < best)
+                    best = elapsed;
+            }
+
+            if (best > 0)
+                printf("        %-8s %8.1f MB/s\n", modes[m].name,
+                       len / best / 1e6);
+            else
+                printf("        %-8s failed\n", modes[m].name);
+        }
+    }
+
+    fclose(file);
+    free(data);
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ast/ast.h"
+#include "eval/eval.h"
+#include "opt/opt.h"
+#include "parse/parse.h"
+
+/*
+ * Apply a formula to every row of columns of values: by parsing one expression
+ * per row, as was done by piping them through `evalexpr`, and by compiling the
+ * formula once to evaluate it on blocks of rows.
+ *
+ * Then a program whose bindings are each evaluated once, against the same
+ * formula with its bindings written out in full.
+ */
+
+#define REPEAT 3
+
+static const char *const names[] = { "x", "y", "z" };
+static const char formula[] = "(x * 3 + y) / 7 - z ^ 2 + x * y";
+static const char program[] = "t = x * y + z; u = t ^ 2 + t; u - t! + u / 3";
+static const char inlined[] =
+    "(x * y + z) ^ 2 + (x * y + z) - (x * y + z)! "
+    "+ ((x * y + z) ^ 2 + (x * y + z)) / 3";
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double per_row(int *const *columns, size_t nb_rows, int *res)
+{
+    double start = now();
+
+    for (size_t i = 0; i < nb_rows; ++i)
+    {
+        char input[128];
+
+        sprintf(input, "(%d * 3 + %d) / 7 - %d ^ 2 + %d * %d", columns[0][i],
+                columns[1][i], columns[2][i], columns[0][i], columns[1][i]);
+
+        struct ast_node *ast = specialize_ast(recursive_parse(input));
+        res[i] = eval_ast(ast);
+        destroy_ast(ast);
+    }
+
+    return now() - start;
+}
+
+static double batched(const char *input, int *const *columns, size_t nb_rows,
+                      int *res)
+{
+    double start = now();
+
+    struct ast_node *ast =
+        specialize_ast(recursive_parse_vars(input, names, 3));
+    struct batch_eval *batch = make_batch_eval(ast, false);
+
+    destroy_ast(ast);
+    batch_eval(batch, (const int *const *)columns, nb_rows, res);
+    destroy_batch_eval(batch);
+
+    return now() - start;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t nb_rows = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    int *memory = malloc(5 * nb_rows * sizeof(*memory));
+    int *columns[] = { memory, memory + nb_rows, memory + 2 * nb_rows };
+    int *expected = memory + 3 * nb_rows;
+    int *res = memory + 4 * nb_rows;
+    unsigned seed = 42;
+
+    if (memory == NULL)
+        return 1;
+
+    for (size_t i = 0; i < 3 * nb_rows; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        memory[i] = (seed >> 16) % 2001;
+    }
+
+    printf("%s, %zu rows\n", formula, nb_rows);
+
+    double best_row = 0;
+    double best_batch = 0;
+    for (int i = 0; i < REPEAT; ++i)
+    {
+        double elapsed = per_row(columns, nb_rows, expected);
+        if (i == 0 || elapsed < best_row)
+            best_row = elapsed;
+
+        elapsed = batched(formula, columns, nb_rows, res);
+        if (i == 0 || elapsed < best_batch)
+            best_batch = elapsed;
+    }
+
+    for (size_t i = 0; i < nb_rows; ++i)
+    {
+        if (res[i] != expected[i])
+        {
+            printf("mismatch on row %zu\n", i);
+            break;
+        }
+    }
+
+    printf("    per row %8.1f Mrows/s\n", nb_rows / best_row / 1e6);
+    printf("    batch   %8.1f Mrows/s\n", nb_rows / best_batch / 1e6);
+
+    double best_program = 0;
+    double best_inlined = 0;
+    for (int i = 0; i < REPEAT; ++i)
+    {
+        double elapsed = batched(inlined, columns, nb_rows, expected);
+        if (i == 0 || elapsed < best_inlined)
+            best_inlined = elapsed;
+
+        elapsed = batched(program, columns, nb_rows, res);
+        if (i == 0 || elapsed < best_program)
+            best_program = elapsed;
+    }
+
+    for (size_t i = 0; i < nb_rows; ++i)
+    {
+        if (res[i] != expected[i])
+        {
+            printf("mismatch on row %zu\n", i);
+            break;
+        }
+    }
+
+    printf("%s, %zu rows\n", program, nb_rows);
+    printf("    inlined %8.1f Mrows/s\n", nb_rows / best_inlined / 1e6);
+    printf("    program %8.1f Mrows/s\n", nb_rows / best_program / 1e6);
+
+    free(memory);
+
+    return 0;
+}
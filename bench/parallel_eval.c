@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ast/ast.h"
+#include "eval/eval.h"
+
+/*
+ * Time the evaluation of a large balanced tree, serially and with pools of
+ * increasing sizes.
+ */
+
+static struct ast_node *make_balanced(unsigned depth, unsigned *seed)
+{
+    static const enum op_kind ops[] = { BINOP_PLUS, BINOP_MINUS, BINOP_TIMES };
+
+    *seed = *seed * 1103515245 + 12345;
+    if (depth == 0)
+        return make_num(*seed % 7);
+
+    enum op_kind op = ops[(*seed >> 16) % 3];
+    struct ast_node *lhs = make_balanced(depth - 1, seed);
+    return make_binop(op, lhs, make_balanced(depth - 1, seed));
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned depth = argc > 1 ? strtoul(argv[1], NULL, 10) : 22;
+    unsigned max_threads = argc > 2 ? strtoul(argv[2], NULL, 10) : 8;
+    unsigned seed = 42;
+
+    struct ast_node *ast = make_balanced(depth, &seed);
+    if (ast == NULL)
+        return 1;
+
+    double start = now();
+    int expected = eval_ast(ast);
+    double serial = now() - start;
+    printf("%zu nodes\nserial: %.3fs\n", ast_size(ast), serial);
+
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2)
+    {
+        struct eval_pool *pool = make_eval_pool(threads, 0);
+        if (pool == NULL)
+            return 1;
+
+        start = now();
+        int res = pool_eval_ast(pool, ast);
+        double elapsed = now() - start;
+
+        printf("%u threads: %.3fs (x%.2f)%s\n", threads, elapsed,
+               serial / elapsed, res == expected ? "" : " MISMATCH");
+
+        destroy_eval_pool(pool);
+    }
+
+    destroy_ast(ast);
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ast/ast.h"
+#include "eval/eval.h"
+#include "parse/parse.h"
+
+/*
+ * Time the parsing of a long sum of terms, serially and with increasing
+ * numbers of threads, using the default cutoff like `evalexpr -j` does: the
+ * input is large enough to be split in one range per thread. Then time the
+ * fallback to the serial parser on unbalanced parenthesis.
+ */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool same_tree(const struct ast_node *lhs, const struct ast_node *rhs)
+{
+    if (lhs == NULL || rhs == NULL)
+        return lhs == rhs;
+
+    return ast_size(lhs) == ast_size(rhs) && eval_ast(lhs) == eval_ast(rhs);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t nb_terms = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    unsigned max_threads = argc > 2 ? strtoul(argv[2], NULL, 10) : 8;
+    char *input = malloc(nb_terms * 16 + 2);
+    size_t len = 0;
+
+    if (input == NULL)
+        return 1;
+
+    input[0] = '\0';
+    for (size_t i = 0; i < nb_terms; ++i)
+        len += sprintf(input + len, "%s(%zu * -%zu)", i % 3 ? " - " : " + ",
+                       i % 100, i % 7);
+
+    double start = now();
+    struct ast_node *expected = recursive_parse(input);
+    double serial = now() - start;
+    printf("%zu bytes\nserial: %.3fs\n", len, serial);
+
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2)
+    {
+        start = now();
+        struct ast_node *ast = parallel_parse(input, threads, 0);
+        double elapsed = now() - start;
+
+        printf("%u threads: %.3fs (x%.2f)%s\n", threads, elapsed,
+               serial / elapsed, same_tree(ast, expected) ? "" : " MISMATCH");
+
+        destroy_ast(ast);
+    }
+
+    destroy_ast(expected);
+
+    // A stray parenthesis is only found after scanning the whole input
+    strcpy(input + len, ")");
+
+    start = now();
+    expected = recursive_parse(input);
+    serial = now() - start;
+
+    start = now();
+    struct ast_node *ast = parallel_parse(input, max_threads, 0);
+    double elapsed = now() - start;
+
+    printf("unbalanced, serial: %.3fs, %u threads: %.3fs (x%.2f)%s\n", serial,
+           max_threads, elapsed, serial / elapsed,
+           ast == NULL && expected == NULL ? "" : " MISMATCH");
+
+    destroy_ast(ast);
+    destroy_ast(expected);
+    free(input);
+
+    return 0;
+}
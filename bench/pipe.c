@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Throughput of `evalexpr` reading many small expressions from a pipe, and
+ * writing their results to another one, using each of its input modes.
+ */
+
+#define REPEAT 3
+#define WRITE_SIZE 4096 // Same as a typical producer using stdio
+
+static const char *const modes[][3] = {
+    { "lines", NULL },
+    { "stream", "-s", NULL },
+    { "epoll", "-a", "epoll" },
+    { "uring", "-a", "uring" },
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned long next(unsigned long *seed)
+{
+    *seed = *seed * 6364136223846793005UL + 1442695040888963407UL;
+    return *seed >> 33;
+}
+
+static char *make_input(size_t nb_lines)
+{
+    char *input = malloc(nb_lines * 80 + 1);
+    unsigned long seed = 42;
+    size_t len = 0;
+
+    if (input == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < nb_lines; ++i)
+    {
+        size_t nb_terms = 1 + next(&seed) % 8;
+
+        len += sprintf(input + len, "%lu", next(&seed) % 1000);
+        for (size_t j = 1; j < nb_terms; ++j)
+            len += sprintf(input + len, " %c %lu", "+-*/"[next(&seed) % 4],
+                           1 + next(&seed) % 1000);
+        input[len++] = '\n';
+    }
+    input[len] = '\0';
+
+    return input;
+}
+
+static void produce(int fd, const char *input, size_t len)
+{
+    for (size_t i = 0; i < len;)
+    {
+        size_t size = len - i < WRITE_SIZE ? len - i : WRITE_SIZE;
+        ssize_t res = write(fd, input + i, size);
+
+        if (res < 0)
+            exit(1);
+        i += res;
+    }
+
+    exit(0);
+}
+
+/*
+ * Returns the number of bytes output, or 0 if anything went wrong.
+ */
+static size_t run(const char *evalexpr, const char *const mode[],
+                  const char *input, size_t len)
+{
+    int in[2];
+    int out[2];
+
+    if (pipe(in) || pipe(out))
+        return 0;
+
+    fflush(stdout); // Do not duplicate our buffered output in the children
+
+    pid_t producer = fork();
+    if (producer == 0)
+    {
+        close(in[0]);
+        close(out[0]);
+        close(out[1]);
+        produce(in[1], input, len);
+    }
+
+    pid_t child = fork();
+    if (child == 0)
+    {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        close(in[0]);
+        close(in[1]);
+        close(out[0]);
+        close(out[1]);
+
+        char *argv[] = { (char *)evalexpr, (char *)mode[1], (char *)mode[2],
+                         NULL };
+        execv(evalexpr, argv);
+        exit(1);
+    }
+
+    close(in[0]);
+    close(in[1]);
+    close(out[1]);
+
+    static char buf[1 << 16];
+    size_t total = 0;
+    ssize_t res;
+    while ((res = read(out[0], buf, sizeof(buf))) > 0)
+        total += res;
+    close(out[0]);
+
+    int status = 1;
+    if (producer < 0 || waitpid(producer, &status, 0) < 0 || status != 0)
+        total = 0;
+    if (child < 0 || waitpid(child, &status, 0) < 0 || status != 0)
+        total = 0;
+
+    return total;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t nb_lines = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    const char *evalexpr = argc > 2 ? argv[2] : "./evalexpr";
+    char *input = make_input(nb_lines);
+
+    if (input == NULL)
+        return 1;
+
+    size_t len = strlen(input);
+    printf("%zu bytes, %zu lines\n", len, nb_lines);
+
+    size_t expected = 0;
+    for (size_t m = 0; m < sizeof(modes) / sizeof(*modes); ++m)
+    {
+        double best = 0;
+        for (int i = 0; i < REPEAT; ++i)
+        {
+            double start = now();
+            size_t output = run(evalexpr, modes[m], input, len);
+            double elapsed = now() - start;
+
+            if (output == 0 || (expected && output != expected))
+            {
+                printf("    %-6s failed\n", modes[m][0]);
+                best = 0;
+                break;
+            }
+            expected = output;
+            if (i == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        if (best > 0)
+            printf("    %-6s %8.1f MB/s\n", modes[m][0], len / best / 1e6);
+    }
+
+    free(input);
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ast/ast.h"
+#include "eval/eval.h"
+#include "opt/opt.h"
+#include "parse/parse.h"
+
+/*
+ * Fraction of the checks of safe arithmetic elided by the range analysis, on
+ * each line of the files given as arguments.
+ *
+ * Then the cost of those checks when evaluating a formula on blocks of rows,
+ * the values of its variables being bounded.
+ */
+
+#define REPEAT 3
+
+static const char *const names[] = { "x", "y", "z" };
+static const char formula[] = "(x * 3 + y) / 7 - z ^ 2 + x * y";
+static const struct value_range bounds[] = { { 0, 2000 }, { 0, 2000 },
+                                             { -2000, 2000 } };
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double percent(const struct range_stats *stats)
+{
+    return stats->nb_checks ? 100. * stats->nb_elided / stats->nb_checks : 100.;
+}
+
+static bool analyze_file(const char *path, struct range_stats *total)
+{
+    FILE *in = fopen(path, "r");
+    struct range_stats stats = { 0, 0 };
+    char *line = NULL;
+    size_t size = 0;
+
+    if (in == NULL)
+        return false;
+
+    while (getline(&line, &size, in) > 0)
+    {
+        struct ast_node *ast = specialize_ast(recursive_parse(line));
+
+        if (ast)
+            analyze_ranges(ast, NULL, &stats);
+        destroy_ast(ast);
+    }
+
+    free(line);
+    fclose(in);
+
+    printf("    %-48s %4zu / %4zu checks elided\n", path, stats.nb_elided,
+           stats.nb_checks);
+    total->nb_checks += stats.nb_checks;
+    total->nb_elided += stats.nb_elided;
+
+    return true;
+}
+
+static double batched(struct batch_eval *batch, const int *const *columns,
+                      size_t nb_rows, int *res)
+{
+    double best = 0;
+
+    for (int i = 0; i < REPEAT; ++i)
+    {
+        double start = now();
+
+        if (!batch_eval(batch, columns, nb_rows, res))
+            puts("unexpected overflow");
+
+        double elapsed = now() - start;
+        if (i == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    return nb_rows / best / 1e6;
+}
+
+static void bench_batch(size_t nb_rows)
+{
+    int *memory = malloc(4 * nb_rows * sizeof(*memory));
+    const int *columns[] = { memory, memory + nb_rows, memory + 2 * nb_rows };
+    int *res = memory + 3 * nb_rows;
+    struct range_stats stats = { 0, 0 };
+    unsigned seed = 42;
+
+    struct ast_node *ast =
+        specialize_ast(recursive_parse_vars(formula, names, 3));
+    struct batch_eval *unchecked = make_batch_eval(ast, false);
+    struct batch_eval *checked = make_batch_eval(ast, true);
+
+    analyze_ranges(ast, bounds, &stats);
+    struct batch_eval *elided = make_batch_eval(ast, true);
+
+    if (memory && unchecked && checked && elided)
+    {
+        for (size_t i = 0; i < 3; ++i)
+        {
+            for (size_t j = 0; j < nb_rows; ++j)
+            {
+                unsigned span = bounds[i].max - bounds[i].min + 1;
+
+                seed = seed * 1103515245 + 12345;
+                memory[i * nb_rows + j] = bounds[i].min + (seed >> 16) % span;
+            }
+        }
+
+        printf("%s, %zu rows, %zu / %zu checks elided\n", formula, nb_rows,
+               stats.nb_elided, stats.nb_checks);
+        printf("    unchecked %8.1f Mrows/s\n",
+               batched(unchecked, columns, nb_rows, res));
+        printf("    checked   %8.1f Mrows/s\n",
+               batched(checked, columns, nb_rows, res));
+        printf("    elided    %8.1f Mrows/s\n",
+               batched(elided, columns, nb_rows, res));
+    }
+
+    destroy_batch_eval(elided);
+    destroy_batch_eval(checked);
+    destroy_batch_eval(unchecked);
+    destroy_ast(ast);
+    free(memory);
+}
+
+int main(int argc, char *argv[])
+{
+    struct range_stats total = { 0, 0 };
+
+    puts("Checks elided by the range analysis");
+    for (int i = 1; i < argc; ++i)
+        if (!analyze_file(argv[i], &total))
+            fprintf(stderr, "Could not read %s\n", argv[i]);
+
+    printf("    total %zu / %zu (%.1f%%)\n", total.nb_elided, total.nb_checks,
+           percent(&total));
+
+    bench_batch(1000000);
+
+    return 0;
+}
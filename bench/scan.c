@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ast/ast.h"
+#include "parse/parse.h"
+#include "parse/scan.h"
+
+/*
+ * Parsing throughput of whitespace-heavy inputs, using each scanning kernel.
+ * The byte-wise kernel is the baseline.
+ */
+
+#define REPEAT 5
+
+static const char *kernel_names[] = {
+    [SCAN_BYTES] = "bytes",
+    [SCAN_SWAR] = "swar",
+    [SCAN_SSE2] = "sse2",
+    [SCAN_AVX2] = "avx2",
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned long next(unsigned long *seed)
+{
+    *seed = *seed * 6364136223846793005UL + 1442695040888963407UL;
+    return *seed >> 33;
+}
+
+static size_t put_spaces(char *buf, unsigned long *seed, unsigned long max)
+{
+    static const char spaces[] = " \t\n";
+    size_t len = next(seed) % (max + 1);
+
+    for (size_t i = 0; i < len; ++i)
+        buf[i] = spaces[next(seed) % 3];
+
+    return len;
+}
+
+/*
+ * Groups of terms in parenthesis, to keep the trees shallow enough to be
+ * destroyed recursively.
+ */
+static char *make_input(size_t nb_groups, unsigned long max_spaces)
+{
+    char *input = malloc(nb_groups * 64 * (max_spaces * 2 + 16) + 1);
+    unsigned long seed = 42;
+    size_t len = 0;
+
+    if (input == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < nb_groups; ++i)
+    {
+        if (i > 0)
+            input[len++] = "+-"[i % 2];
+        input[len++] = '(';
+        for (size_t j = 0; j < 64; ++j)
+        {
+            len += put_spaces(input + len, &seed, max_spaces);
+            if (j > 0)
+                input[len++] = "+-*"[next(&seed) % 3];
+            len += put_spaces(input + len, &seed, max_spaces);
+            len += sprintf(input + len, "%lu", next(&seed) % 1000000000);
+        }
+        input[len++] = ')';
+    }
+    input[len] = '\0';
+
+    return input;
+}
+
+static void bench_parser(const char *name,
+                         struct ast_node *(*parse)(const char *input),
+                         const char *input, size_t len)
+{
+    printf("%s:\n", name);
+
+    for (size_t k = 0; k < sizeof(kernel_names) / sizeof(*kernel_names); ++k)
+    {
+        if (!set_scan_kernel(k))
+            continue;
+
+        double best = 0;
+        for (int i = 0; i < REPEAT; ++i)
+        {
+            double start = now();
+            struct ast_node *ast = parse(input);
+            double elapsed = now() - start;
+
+            if (ast == NULL)
+                puts("    parse error");
+            destroy_ast(ast);
+            if (i == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        printf("    %-5s %8.1f MB/s\n", kernel_names[k], len / best / 1e6);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t nb_groups = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000;
+    enum scan_kernel kernel = get_scan_kernel();
+
+    static const unsigned long max_spaces[] = { 1, 8, 64 };
+    for (size_t i = 0; i < sizeof(max_spaces) / sizeof(*max_spaces); ++i)
+    {
+        char *input = make_input(nb_groups, max_spaces[i]);
+        if (input == NULL)
+            return 1;
+
+        size_t len = strlen(input);
+        printf("%zu bytes, up to %lu spaces between tokens\n", len,
+               max_spaces[i]);
+        bench_parser("climbing", climbing_parse, input, len);
+        bench_parser("recursive", recursive_parse, input, len);
+
+        free(input);
+    }
+
+    set_scan_kernel(kernel);
+
+    return 0;
+}
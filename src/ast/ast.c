@@ -1,6 +1,7 @@
 #include "ast.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 struct ast_node *make_num(int val)
 {
@@ -9,12 +10,29 @@ struct ast_node *make_num(int val)
     if (ret == NULL)
         return ret;
 
+    ret->size = 1;
     ret->kind = NODE_NUM;
+    ret->safe = false;
     ret->val.num = val;
 
     return ret;
 }
 
+struct ast_node *make_var(size_t index)
+{
+    struct ast_node *ret = malloc(sizeof(*ret));
+
+    if (ret == NULL)
+        return ret;
+
+    ret->size = 1;
+    ret->kind = NODE_VAR;
+    ret->safe = false;
+    ret->val.var = index;
+
+    return ret;
+}
+
 struct ast_node *make_unop(enum op_kind op, struct ast_node *tree)
 {
     // Defensive programming
@@ -26,7 +44,9 @@ struct ast_node *make_unop(enum op_kind op, struct ast_node *tree)
     if (ret == NULL)
         return ret;
 
+    ret->size = 1 + ast_size(tree);
     ret->kind = NODE_UNOP;
+    ret->safe = false;
     ret->val.un_op.op = op;
     ret->val.un_op.tree = tree;
 
@@ -45,7 +65,9 @@ struct ast_node *make_binop(enum op_kind op, struct ast_node *lhs,
     if (ret == NULL)
         return ret;
 
+    ret->size = 1 + ast_size(lhs) + ast_size(rhs);
     ret->kind = NODE_BINOP;
+    ret->safe = false;
     ret->val.bin_op.op = op;
     ret->val.bin_op.lhs = lhs;
     ret->val.bin_op.rhs = rhs;
@@ -53,23 +75,145 @@ struct ast_node *make_binop(enum op_kind op, struct ast_node *lhs,
     return ret;
 }
 
+struct ast_node *make_constop(enum op_kind op, struct ast_node *tree, int val)
+{
+    struct ast_node *ret = malloc(sizeof(*ret));
+
+    if (ret == NULL)
+        return ret;
+
+    ret->size = 1 + ast_size(tree);
+    ret->kind = NODE_CONSTOP;
+    ret->safe = false;
+    ret->val.const_op.op = op;
+    ret->val.const_op.tree = tree;
+    ret->val.const_op.val = val;
+    ret->val.const_op.magic = 0;
+    ret->val.const_op.shift = 0;
+
+    return ret;
+}
+
+struct ast_node *make_let(size_t var, struct ast_node *value,
+                          struct ast_node *body)
+{
+    struct ast_node *ret = malloc(sizeof(*ret));
+
+    if (ret == NULL)
+        return ret;
+
+    ret->size = 1 + ast_size(value) + ast_size(body);
+    ret->kind = NODE_LET;
+    ret->safe = false;
+    ret->val.let.var = var;
+    ret->val.let.value = value;
+    ret->val.let.body = body;
+
+    return ret;
+}
+
+/*
+ * Only recurses on the left operands which are not binary operators, and on
+ * the bound values: left-associative chains are rotated into right ones, which
+ * are destroyed in a loop.
+ */
 void destroy_ast(struct ast_node *ast)
+{
+    while (ast)
+    {
+        struct ast_node *next = NULL;
+
+        switch (ast->kind)
+        {
+        case NODE_BINOP:
+            next = ast->val.bin_op.lhs;
+            if (next && next->kind == NODE_BINOP)
+            {
+                ast->val.bin_op.lhs = next->val.bin_op.rhs;
+                next->val.bin_op.rhs = ast;
+                ast = next;
+                continue;
+            }
+            destroy_ast(next);
+            next = ast->val.bin_op.rhs;
+            break;
+        case NODE_UNOP:
+            next = ast->val.un_op.tree;
+            break;
+        case NODE_LET:
+            destroy_ast(ast->val.let.value);
+            next = ast->val.let.body;
+            break;
+        case NODE_CONSTOP:
+            next = ast->val.const_op.tree;
+            break;
+        case NODE_NUM:
+        case NODE_VAR:
+            break;
+        }
+
+        free(ast);
+        ast = next;
+    }
+}
+
+size_t ast_size(const struct ast_node *ast)
 {
     if (!ast)
-        return;
+        return 0;
+
+    return ast->size;
+}
 
-    switch (ast->kind)
+void init_spine(struct ast_spine *spine)
+{
+    spine->nodes = spine->buf;
+    spine->len = 0;
+    spine->capacity = sizeof(spine->buf) / sizeof(*spine->buf);
+}
+
+static bool grow_spine(struct ast_spine *spine)
+{
+    size_t capacity = spine->capacity * 2;
+    struct ast_node **nodes = spine->nodes == spine->buf
+        ? malloc(capacity * sizeof(*nodes))
+        : realloc(spine->nodes, capacity * sizeof(*nodes));
+
+    if (nodes == NULL)
+        return false;
+
+    if (spine->nodes == spine->buf)
+        memcpy(nodes, spine->buf, sizeof(spine->buf));
+    spine->nodes = nodes;
+    spine->capacity = capacity;
+
+    return true;
+}
+
+struct ast_node *walk_spine(struct ast_spine *spine,
+                            const struct ast_node *ast)
+{
+    // Like `strchr`, const is cast away: only passes owning the tree write it
+    struct ast_node *node = (struct ast_node *)ast;
+
+    for (; node->kind == NODE_BINOP; node = node->val.bin_op.lhs)
     {
-    case NODE_BINOP:
-        destroy_ast(ast->val.bin_op.lhs);
-        destroy_ast(ast->val.bin_op.rhs);
-        break;
-    case NODE_UNOP:
-        destroy_ast(ast->val.un_op.tree);
-        /* fallthrough */
-    case NODE_NUM:
-        break;
+        if (spine->len == spine->capacity && !grow_spine(spine))
+            return NULL;
+        spine->nodes[spine->len++] = node;
     }
 
-    free(ast);
+    return node;
+}
+
+struct ast_node *pop_spine(struct ast_spine *spine)
+{
+    return spine->len > 0 ? spine->nodes[--spine->len] : NULL;
+}
+
+void destroy_spine(struct ast_spine *spine)
+{
+    if (spine->nodes != spine->buf)
+        free(spine->nodes);
+    init_spine(spine);
 }
@@ -1,6 +1,9 @@
 #ifndef AST_H
 #define AST_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 // Forward declaration
 struct ast_node;
 
@@ -32,29 +35,95 @@ struct binop_node
     struct ast_node *rhs;
 };
 
+/*
+ * Operator applied to a single non-constant operand, the constant operand
+ * being used to precompute how to evaluate it. See `specialize_ast`.
+ */
+struct constop_node
+{
+    enum op_kind op;
+    struct ast_node *tree;
+    int val; // Constant operand
+    int magic; // Multiplier for divisions, exponent for powers
+    int shift;
+};
+
+/*
+ * Variable bound to a value within the body, see `recursive_parse_vars`.
+ * Bindings are only found at the root of the tree, one after the other.
+ */
+struct let_node
+{
+    size_t var;
+    struct ast_node *value;
+    struct ast_node *body;
+};
+
 struct ast_node
 {
+    size_t size; // Number of nodes in this subtree
     enum node_kind
     {
         NODE_UNOP,
         NODE_BINOP,
         NODE_NUM,
+        NODE_CONSTOP,
+        NODE_VAR,
+        NODE_LET,
     } kind;
+    bool safe; // Cannot overflow nor divide by zero, see `analyze_ranges`
     union ast_val
     {
         struct unop_node un_op;
         struct binop_node bin_op;
+        struct constop_node const_op;
+        struct let_node let;
         int num;
+        size_t var; // Index of the variable, bound when evaluating batches
     } val;
 };
 
 struct ast_node *make_num(int val);
 
+struct ast_node *make_var(size_t index);
+
 struct ast_node *make_unop(enum op_kind op, struct ast_node *tree);
 
 struct ast_node *make_binop(enum op_kind op, struct ast_node *lhs,
                             struct ast_node *rhs);
 
+struct ast_node *make_constop(enum op_kind op, struct ast_node *tree, int val);
+
+struct ast_node *make_let(size_t var, struct ast_node *value,
+                          struct ast_node *body);
+
 void destroy_ast(struct ast_node *ast);
 
+size_t ast_size(const struct ast_node *ast);
+
+/*
+ * Binary operators along the left spine of a tree, from its root down.
+ * Left-associative chains such as `1 + 1 + ... + 1` are as deep as they are
+ * long: passes over the tree walk them back up in a loop, and only recurse on
+ * the right operands.
+ */
+struct ast_spine
+{
+    struct ast_node **nodes;
+    size_t len;
+    size_t capacity;
+    struct ast_node *buf[8]; // Used until the spine gets longer
+};
+
+void init_spine(struct ast_spine *spine);
+
+// Returns the bottom of the spine, or NULL if memory ran out
+struct ast_node *walk_spine(struct ast_spine *spine,
+                            const struct ast_node *ast);
+
+// Returns the binary operators from the bottom up, then NULL
+struct ast_node *pop_spine(struct ast_spine *spine);
+
+void destroy_spine(struct ast_spine *spine);
+
 #endif /* !AST_H */
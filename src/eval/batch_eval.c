@@ -0,0 +1,397 @@
+#include "eval.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define UNREACHABLE() __builtin_unreachable()
+
+// Rows evaluated by each instruction at once, small enough to stay in cache
+#define BLOCK_ROWS 1024
+
+/*
+ * Registers hold a whole block of rows, and are allocated like a stack: an
+ * instruction's operands are its destination register and the one above it.
+ */
+struct instr
+{
+    enum instr_kind
+    {
+        INSTR_NUM,
+        INSTR_VAR,
+        INSTR_REG, // Copy of a binding's register
+        INSTR_UNOP,
+        INSTR_BINOP,
+        INSTR_CONSTOP,
+    } kind;
+    size_t reg;
+    bool checked; // Errors are detected, with safe arithmetic
+    union
+    {
+        int num;
+        size_t var;
+        size_t reg;
+        enum op_kind op;
+        struct constop_node const_op; // Its tree is not used
+    } arg;
+};
+
+struct batch_eval
+{
+    struct instr *instrs;
+    size_t nb_instrs;
+    size_t nb_regs;
+    size_t result; // Register holding the results
+    int *regs;
+};
+
+// Variable bound by the program, see `compile_program`
+struct binding
+{
+    const struct let_node *let;
+    bool used;
+    size_t reg;
+};
+
+struct compiler
+{
+    struct batch_eval *batch;
+    bool safe;
+    struct binding *bindings;
+    size_t nb_bindings;
+    size_t first_var; // Variable of the first binding, the others follow
+};
+
+static struct instr *emit(struct batch_eval *batch, enum instr_kind kind,
+                          size_t reg, bool checked)
+{
+    struct instr *instr = &batch->instrs[batch->nb_instrs++];
+
+    instr->kind = kind;
+    instr->reg = reg;
+    instr->checked = checked;
+    if (reg >= batch->nb_regs)
+        batch->nb_regs = reg + 1;
+
+    return instr;
+}
+
+// Returns NULL if the variable is not bound by the program
+static struct binding *find_binding(const struct compiler *comp, size_t var)
+{
+    if (var < comp->first_var || var - comp->first_var >= comp->nb_bindings)
+        return NULL;
+
+    return &comp->bindings[var - comp->first_var];
+}
+
+/*
+ * Emit the instructions evaluating the tree into `reg`, in postfix order.
+ */
+static void compile(const struct compiler *comp, const struct ast_node *ast,
+                    size_t reg)
+{
+    struct batch_eval *batch = comp->batch;
+    const struct binding *binding = NULL;
+    bool checked = comp->safe && !ast->safe;
+
+    switch (ast->kind)
+    {
+    case NODE_NUM:
+        emit(batch, INSTR_NUM, reg, false)->arg.num = ast->val.num;
+        return;
+    case NODE_VAR:
+        if ((binding = find_binding(comp, ast->val.var)) != NULL)
+            emit(batch, INSTR_REG, reg, false)->arg.reg = binding->reg;
+        else
+            emit(batch, INSTR_VAR, reg, false)->arg.var = ast->val.var;
+        return;
+    case NODE_UNOP:
+        compile(comp, ast->val.un_op.tree, reg);
+        emit(batch, INSTR_UNOP, reg, checked)->arg.op = ast->val.un_op.op;
+        return;
+    case NODE_BINOP:
+        compile(comp, ast->val.bin_op.lhs, reg);
+        compile(comp, ast->val.bin_op.rhs, reg + 1);
+        emit(batch, INSTR_BINOP, reg, checked)->arg.op = ast->val.bin_op.op;
+        return;
+    case NODE_CONSTOP:
+        compile(comp, ast->val.const_op.tree, reg);
+        emit(batch, INSTR_CONSTOP, reg, checked)->arg.const_op =
+            ast->val.const_op;
+        return;
+    case NODE_LET:
+        break; // Only at the root, see `compile_program`
+    }
+    UNREACHABLE();
+}
+
+static void mark_used(const struct compiler *comp, const struct ast_node *ast)
+{
+    struct binding *binding = NULL;
+
+    switch (ast->kind)
+    {
+    case NODE_NUM:
+    case NODE_LET:
+        return;
+    case NODE_VAR:
+        if ((binding = find_binding(comp, ast->val.var)) != NULL)
+            binding->used = true;
+        return;
+    case NODE_UNOP:
+        mark_used(comp, ast->val.un_op.tree);
+        return;
+    case NODE_BINOP:
+        mark_used(comp, ast->val.bin_op.lhs);
+        mark_used(comp, ast->val.bin_op.rhs);
+        return;
+    case NODE_CONSTOP:
+        mark_used(comp, ast->val.const_op.tree);
+        return;
+    }
+    UNREACHABLE();
+}
+
+/*
+ * Bindings which are used get a register each, the ones below those used to
+ * evaluate what follows them, and are evaluated exactly once. The others are
+ * not compiled at all: bindings are only used by the ones after them, so a
+ * single pass from the result backwards finds them all.
+ */
+static bool compile_program(struct batch_eval *batch,
+                            const struct ast_node *ast, bool safe)
+{
+    struct compiler comp = { batch, safe, NULL, 0, 0 };
+    const struct ast_node *result = ast;
+
+    for (; result->kind == NODE_LET; result = result->val.let.body)
+        comp.nb_bindings += 1;
+
+    // One more, not to depend on the behaviour of `malloc(0)`
+    comp.bindings = calloc(comp.nb_bindings + 1, sizeof(*comp.bindings));
+    if (comp.bindings == NULL)
+        return false;
+
+    const struct ast_node *let = ast;
+    for (size_t i = 0; i < comp.nb_bindings; ++i)
+    {
+        comp.bindings[i].let = &let->val.let;
+        let = let->val.let.body;
+    }
+    if (comp.nb_bindings > 0)
+        comp.first_var = comp.bindings[0].let->var;
+
+    mark_used(&comp, result);
+    for (size_t i = comp.nb_bindings; i-- > 0;)
+        if (comp.bindings[i].used)
+            mark_used(&comp, comp.bindings[i].let->value);
+
+    size_t reg = 0;
+    for (size_t i = 0; i < comp.nb_bindings; ++i)
+    {
+        if (!comp.bindings[i].used)
+            continue;
+
+        compile(&comp, comp.bindings[i].let->value, reg);
+        comp.bindings[i].reg = reg++;
+    }
+
+    compile(&comp, result, reg);
+    batch->result = reg;
+
+    free(comp.bindings);
+    return true;
+}
+
+/*
+ * Compile the tree into a sequence of instructions, each one applied to blocks
+ * of rows at once: the tree is walked once per block instead of once per row.
+ *
+ * With `safe` arithmetic, the operators which are not marked as safe are
+ * checked. Programs are compiled into a single sequence, their bindings being
+ * kept in registers. The tree is not needed anymore once compiled.
+ */
+struct batch_eval *make_batch_eval(const struct ast_node *ast, bool safe)
+{
+    if (ast == NULL)
+        return NULL;
+
+    struct batch_eval *ret = calloc(1, sizeof(*ret));
+
+    if (ret == NULL)
+        return NULL;
+
+    // There is at most one instruction per node
+    if ((ret->instrs = malloc(ast->size * sizeof(*ret->instrs))) == NULL)
+    {
+        free(ret);
+        return NULL;
+    }
+
+    if (!compile_program(ret, ast, safe))
+    {
+        destroy_batch_eval(ret);
+        return NULL;
+    }
+
+    ret->regs = malloc(ret->nb_regs * BLOCK_ROWS * sizeof(*ret->regs));
+    if (ret->regs == NULL)
+    {
+        destroy_batch_eval(ret);
+        return NULL;
+    }
+
+    return ret;
+}
+
+static void run_unop(enum op_kind op, int *dst, size_t nb_rows)
+{
+    switch (op)
+    {
+    case UNOP_IDENTITY:
+        break;
+    case UNOP_NEGATE:
+        for (size_t i = 0; i < nb_rows; ++i)
+            dst[i] = -dst[i];
+        break;
+    default:
+        for (size_t i = 0; i < nb_rows; ++i)
+            dst[i] = apply_unop(op, dst[i]);
+        break;
+    }
+}
+
+static void run_binop(enum op_kind op, int *dst, const int *rhs,
+                      size_t nb_rows)
+{
+    // The simplest operators are written out, to be vectorized
+    switch (op)
+    {
+    case BINOP_PLUS:
+        for (size_t i = 0; i < nb_rows; ++i)
+            dst[i] = dst[i] + rhs[i];
+        break;
+    case BINOP_MINUS:
+        for (size_t i = 0; i < nb_rows; ++i)
+            dst[i] = dst[i] - rhs[i];
+        break;
+    case BINOP_TIMES:
+        for (size_t i = 0; i < nb_rows; ++i)
+            dst[i] = dst[i] * rhs[i];
+        break;
+    default:
+        for (size_t i = 0; i < nb_rows; ++i)
+            dst[i] = apply_binop(op, dst[i], rhs[i]);
+        break;
+    }
+}
+
+/*
+ * Errors are accumulated over the whole block, instead of branching out of the
+ * loop on each row.
+ */
+static bool run_checked(const struct instr *instr, int *dst, size_t nb_rows)
+{
+    const int *rhs = dst + BLOCK_ROWS;
+    bool ret = true;
+
+    switch (instr->kind)
+    {
+    case INSTR_UNOP:
+        for (size_t i = 0; i < nb_rows; ++i)
+            ret &= checked_unop(instr->arg.op, dst[i], &dst[i]);
+        break;
+    case INSTR_BINOP:
+        for (size_t i = 0; i < nb_rows; ++i)
+            ret &= checked_binop(instr->arg.op, dst[i], rhs[i], &dst[i]);
+        break;
+    case INSTR_CONSTOP:
+        for (size_t i = 0; i < nb_rows; ++i)
+            ret &= checked_constop(&instr->arg.const_op, dst[i], &dst[i]);
+        break;
+    default:
+        UNREACHABLE();
+    }
+
+    return ret;
+}
+
+static bool run_block(struct batch_eval *batch, const int *const *vars,
+                      size_t offset, size_t nb_rows)
+{
+    for (size_t i = 0; i < batch->nb_instrs; ++i)
+    {
+        const struct instr *instr = &batch->instrs[i];
+        int *dst = batch->regs + instr->reg * BLOCK_ROWS;
+
+        if (instr->checked)
+        {
+            if (!run_checked(instr, dst, nb_rows))
+                return false;
+            continue;
+        }
+
+        switch (instr->kind)
+        {
+        case INSTR_NUM:
+            for (size_t j = 0; j < nb_rows; ++j)
+                dst[j] = instr->arg.num;
+            break;
+        case INSTR_VAR:
+            memcpy(dst, vars[instr->arg.var] + offset, nb_rows * sizeof(*dst));
+            break;
+        case INSTR_REG:
+            memcpy(dst, batch->regs + instr->arg.reg * BLOCK_ROWS,
+                   nb_rows * sizeof(*dst));
+            break;
+        case INSTR_UNOP:
+            run_unop(instr->arg.op, dst, nb_rows);
+            break;
+        case INSTR_BINOP:
+            run_binop(instr->arg.op, dst, dst + BLOCK_ROWS, nb_rows);
+            break;
+        case INSTR_CONSTOP:
+            for (size_t j = 0; j < nb_rows; ++j)
+                dst[j] = apply_constop(&instr->arg.const_op, dst[j]);
+            break;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Evaluate the compiled tree on each row, the value of the variable of index
+ * `i` being `vars[i][row]`. Results are the same as `eval_ast` would give, had
+ * the variables been replaced by their values.
+ *
+ * Returns false if an error was detected with safe arithmetic, in which case
+ * only the results of the rows before its block are written.
+ */
+bool batch_eval(struct batch_eval *batch, const int *const *vars,
+                size_t nb_rows, int *res)
+{
+    for (size_t offset = 0; offset < nb_rows; offset += BLOCK_ROWS)
+    {
+        size_t len = nb_rows - offset;
+
+        if (len > BLOCK_ROWS)
+            len = BLOCK_ROWS;
+        if (!run_block(batch, vars, offset, len))
+            return false;
+        memcpy(res + offset, batch->regs + batch->result * BLOCK_ROWS,
+               len * sizeof(*res));
+    }
+
+    return true;
+}
+
+void destroy_batch_eval(struct batch_eval *batch)
+{
+    if (batch == NULL)
+        return;
+
+    free(batch->regs);
+    free(batch->instrs);
+    free(batch);
+}
@@ -1,6 +1,27 @@
 #include "eval.h"
 
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+
 #define UNREACHABLE() __builtin_unreachable()
+#define ARR_SIZE(Arr) (sizeof(Arr) / sizeof(*Arr))
+
+// Deeper left operands are walked in a loop instead of being recursed on
+#define MAX_LHS_DEPTH 64
+
+// Keep the spine out of the frames of the recursive evaluation, for speed
+#define NOINLINE __attribute__((noinline))
+
+// Factorials modulo 2^32, every one after those is a multiple of 2^32
+static const unsigned fact_table[] = {
+    1u, 1u, 2u, 6u, 24u, 120u, 720u, 5040u, 40320u, 362880u, 3628800u,
+    39916800u, 479001600u, 1932053504u, 1278945280u, 2004310016u,
+    2004189184u, 4006445056u, 3396534272u, 109641728u, 2192834560u,
+    3099852800u, 3772252160u, 862453760u, 3519021056u, 2076180480u,
+    2441084928u, 1484783616u, 2919235584u, 3053453312u, 1409286144u,
+    738197504u, 2147483648u, 2147483648u,
+};
 
 static int my_pow(int lhs, int rhs)
 {
@@ -20,43 +41,148 @@ static int my_fact(int num)
     return ret;
 }
 
-static int eval_unop(const struct unop_node *un_op)
+/*
+ * Multiply-and-shift division, using the magic number computed by
+ * `specialize_ast`, see Hacker's Delight chapter 10.
+ */
+static int magic_div(int num, const struct constop_node *const_op)
 {
-    switch (un_op->op)
+    int64_t q = ((int64_t)const_op->magic * num) >> 32;
+
+    if (const_op->val > 0 && const_op->magic < 0)
+        q += num;
+    else if (const_op->val < 0 && const_op->magic > 0)
+        q -= num;
+    q >>= const_op->shift;
+
+    // Truncate towards zero
+    return q + (q < 0);
+}
+
+/*
+ * Exponentiation by squaring, with the exponent's bits known in advance.
+ *
+ * Negative exponents behave like their absolute value in `my_pow`.
+ */
+static int chain_pow(int num, const struct constop_node *const_op)
+{
+    unsigned exp = const_op->magic;
+    unsigned ret = 1;
+
+    for (int i = const_op->shift; i >= 0; --i)
+    {
+        ret *= ret;
+        if ((exp >> i) & 1)
+            ret *= num;
+    }
+
+    return ret;
+}
+
+static int table_fact(int num)
+{
+    if (num < 0)
+        return 1;
+    if ((unsigned)num >= ARR_SIZE(fact_table))
+        return 0;
+    return fact_table[num];
+}
+
+int apply_constop(const struct constop_node *const_op, int val)
+{
+    switch (const_op->op)
+    {
+    case BINOP_DIVIDES:
+        return magic_div(val, const_op);
+    case BINOP_POW:
+        return chain_pow(val, const_op);
+    case UNOP_FACT:
+        return table_fact(val);
+    default:
+        UNREACHABLE();
+    }
+}
+
+int apply_unop(enum op_kind op, int val)
+{
+    switch (op)
     {
     case UNOP_IDENTITY:
-        return eval_ast(un_op->tree);
+        return val;
     case UNOP_NEGATE:
-        return -eval_ast(un_op->tree);
+        return -val;
     case UNOP_FACT:
-        return my_fact(eval_ast(un_op->tree));
+        return my_fact(val);
     default:
         UNREACHABLE();
     }
 }
 
-static int eval_binop(const struct binop_node *bin_op)
+int apply_binop(enum op_kind op, int lhs, int rhs)
 {
-#define EVAL_OP(OP, TREE) (eval_ast((TREE)->lhs) OP eval_ast((TREE)->rhs))
-    switch (bin_op->op)
+    switch (op)
     {
     case BINOP_PLUS:
-        return EVAL_OP(+, bin_op);
+        return lhs + rhs;
     case BINOP_MINUS:
-        return EVAL_OP(-, bin_op);
+        return lhs - rhs;
     case BINOP_TIMES:
-        return EVAL_OP(*, bin_op);
+        return lhs * rhs;
     case BINOP_DIVIDES:
-        return EVAL_OP(/, bin_op);
+        return lhs / rhs;
     case BINOP_POW:
-        return my_pow(eval_ast(bin_op->lhs), eval_ast(bin_op->rhs));
+        return my_pow(lhs, rhs);
     default:
         UNREACHABLE();
     }
-#undef EVAL_OP
 }
 
-int eval_ast(const struct ast_node *ast)
+static int eval_node(const struct ast_node *ast, unsigned depth);
+
+static int eval_constop(const struct constop_node *const_op)
+{
+    return apply_constop(const_op, eval_node(const_op->tree, 0));
+}
+
+static int eval_unop(const struct unop_node *un_op)
+{
+    return apply_unop(un_op->op, eval_node(un_op->tree, 0));
+}
+
+/*
+ * Binary operators along the left spine are applied in a loop, so that long
+ * left-associative chains do not recurse as deep as they are long.
+ */
+NOINLINE static int eval_spine(const struct ast_node *ast)
+{
+    struct ast_spine spine;
+    init_spine(&spine);
+
+    const struct ast_node *node = walk_spine(&spine, ast);
+    if (node == NULL)
+        abort(); // Out of memory, with no way to report it
+
+    int ret = eval_node(node, 0);
+    while ((node = pop_spine(&spine)))
+    {
+        const struct binop_node *bin_op = &node->val.bin_op;
+        ret = apply_binop(bin_op->op, ret, eval_node(bin_op->rhs, 0));
+    }
+
+    destroy_spine(&spine);
+    return ret;
+}
+
+// Recursing is faster, as long as the left operands are not too deep
+static int eval_binop(const struct binop_node *bin_op, unsigned depth)
+{
+    int lhs = depth < MAX_LHS_DEPTH ? eval_node(bin_op->lhs, depth + 1)
+                                    : eval_spine(bin_op->lhs);
+    return apply_binop(bin_op->op, lhs, eval_node(bin_op->rhs, 0));
+}
+
+// `depth` is the number of left operands this node is nested in, in a row
+static int eval_node(const struct ast_node *ast, unsigned depth)
 {
     switch (ast->kind)
     {
@@ -65,7 +191,193 @@ int eval_ast(const struct ast_node *ast)
     case NODE_UNOP:
         return eval_unop(&ast->val.un_op);
     case NODE_BINOP:
-        return eval_binop(&ast->val.bin_op);
+        return eval_binop(&ast->val.bin_op, depth);
+    case NODE_CONSTOP:
+        return eval_constop(&ast->val.const_op);
+    case NODE_VAR:
+    case NODE_LET:
+        break;
+    }
+    abort(); // Variables are only bound by `batch_eval`
+}
+
+int eval_ast(const struct ast_node *ast)
+{
+    return eval_node(ast, 0);
+}
+
+/*
+ * Safe arithmetic: results which do not fit in an `int` are errors, instead of
+ * wrapping around, as are divisions by zero.
+ */
+
+static bool checked_fact(int num, int *res)
+{
+    if (num > MAX_FACT)
+        return false;
+
+    *res = table_fact(num);
+    return true;
+}
+
+/*
+ * Negative exponents behave like their absolute value, as in `my_pow`.
+ */
+static bool checked_pow(int lhs, int rhs, int *res)
+{
+    unsigned exp = rhs < 0 ? -(unsigned)rhs : (unsigned)rhs;
+    int64_t ret = 1;
+
+    // The only bases whose powers can stay small
+    if (lhs >= -1 && lhs <= 1)
+    {
+        *res = lhs == 0 ? exp == 0 : (lhs == 1 || exp % 2 == 0 ? 1 : -1);
+        return true;
+    }
+
+    // Bigger exponents overflow for sure, keep the loop short
+    if (exp >= 32)
+        return false;
+
+    while (exp-- > 0)
+    {
+        ret *= lhs;
+        if (ret < INT_MIN || ret > INT_MAX)
+            return false;
+    }
+
+    *res = ret;
+    return true;
+}
+
+bool checked_unop(enum op_kind op, int val, int *res)
+{
+    switch (op)
+    {
+    case UNOP_IDENTITY:
+        *res = val;
+        return true;
+    case UNOP_NEGATE:
+        return !__builtin_sub_overflow(0, val, res);
+    case UNOP_FACT:
+        return checked_fact(val, res);
+    default:
+        UNREACHABLE();
+    }
+}
+
+bool checked_binop(enum op_kind op, int lhs, int rhs, int *res)
+{
+    switch (op)
+    {
+    case BINOP_PLUS:
+        return !__builtin_add_overflow(lhs, rhs, res);
+    case BINOP_MINUS:
+        return !__builtin_sub_overflow(lhs, rhs, res);
+    case BINOP_TIMES:
+        return !__builtin_mul_overflow(lhs, rhs, res);
+    case BINOP_DIVIDES:
+        if (rhs == 0 || (lhs == INT_MIN && rhs == -1))
+            return false;
+        *res = lhs / rhs;
+        return true;
+    case BINOP_POW:
+        return checked_pow(lhs, rhs, res);
+    default:
+        UNREACHABLE();
+    }
+}
+
+bool checked_constop(const struct constop_node *const_op, int val, int *res)
+{
+    switch (const_op->op)
+    {
+    case BINOP_DIVIDES:
+        // Never by 0 nor -1, see `specialize_ast`
+        *res = magic_div(val, const_op);
+        return true;
+    case BINOP_POW:
+        return checked_pow(val, const_op->val, res);
+    case UNOP_FACT:
+        return checked_fact(val, res);
+    default:
+        UNREACHABLE();
+    }
+}
+
+static bool safe_eval_node(const struct ast_node *ast, unsigned depth,
+                           int *res);
+
+static bool safe_apply_binop(const struct ast_node *ast, int lhs, int rhs,
+                             int *res)
+{
+    if (ast->safe)
+        *res = apply_binop(ast->val.bin_op.op, lhs, rhs);
+    return ast->safe || checked_binop(ast->val.bin_op.op, lhs, rhs, res);
+}
+
+/*
+ * Same as `eval_spine`, running out of memory is an error too.
+ */
+NOINLINE static bool safe_eval_spine(const struct ast_node *ast, int *res)
+{
+    struct ast_spine spine;
+    init_spine(&spine);
+
+    const struct ast_node *node = walk_spine(&spine, ast);
+    bool ret = node && safe_eval_node(node, 0, res);
+
+    int rhs;
+    while (ret && (node = pop_spine(&spine)))
+        ret = safe_eval_node(node->val.bin_op.rhs, 0, &rhs)
+            && safe_apply_binop(node, *res, rhs, res);
+
+    destroy_spine(&spine);
+    return ret;
+}
+
+static bool safe_eval_node(const struct ast_node *ast, unsigned depth,
+                           int *res)
+{
+    int lhs;
+    int rhs;
+
+    switch (ast->kind)
+    {
+    case NODE_NUM:
+        *res = ast->val.num;
+        return true;
+    case NODE_VAR:
+    case NODE_LET:
+        return false; // Variables are only bound by `batch_eval`
+    case NODE_UNOP:
+        if (!safe_eval_node(ast->val.un_op.tree, 0, &lhs))
+            return false;
+        if (ast->safe)
+            *res = apply_unop(ast->val.un_op.op, lhs);
+        return ast->safe || checked_unop(ast->val.un_op.op, lhs, res);
+    case NODE_BINOP:
+        if (depth < MAX_LHS_DEPTH
+                ? !safe_eval_node(ast->val.bin_op.lhs, depth + 1, &lhs)
+                : !safe_eval_spine(ast->val.bin_op.lhs, &lhs))
+            return false;
+        return safe_eval_node(ast->val.bin_op.rhs, 0, &rhs)
+            && safe_apply_binop(ast, lhs, rhs, res);
+    case NODE_CONSTOP:
+        if (!safe_eval_node(ast->val.const_op.tree, 0, &lhs))
+            return false;
+        if (ast->safe)
+            *res = apply_constop(&ast->val.const_op, lhs);
+        return ast->safe || checked_constop(&ast->val.const_op, lhs, res);
     }
     UNREACHABLE();
 }
+
+/*
+ * Evaluate the tree using safe arithmetic, returns false on errors. Operators
+ * which are marked as safe are not checked.
+ */
+bool safe_eval_ast(const struct ast_node *ast, int *res)
+{
+    return safe_eval_node(ast, 0, res);
+}
@@ -1,8 +1,48 @@
 #ifndef EVAL_H
 #define EVAL_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "ast/ast.h"
 
+// Factorials of bigger numbers do not fit in an `int`
+#define MAX_FACT 12
+
+/*
+ * Trees given to `eval_ast`, `safe_eval_ast` and `pool_eval_ast` must not
+ * contain variables nor bindings, which only `batch_eval` binds: trees from
+ * `recursive_parse_vars` are evaluated in batches. `eval_ast` and
+ * `pool_eval_ast` abort on them, `safe_eval_ast` returns false.
+ */
 int eval_ast(const struct ast_node *ast);
 
+// Apply an operator to already evaluated operands
+int apply_unop(enum op_kind op, int val);
+int apply_binop(enum op_kind op, int lhs, int rhs);
+int apply_constop(const struct constop_node *const_op, int val);
+
+// Same as above, returning false on overflows and divisions by zero
+bool checked_unop(enum op_kind op, int val, int *res);
+bool checked_binop(enum op_kind op, int lhs, int rhs, int *res);
+bool checked_constop(const struct constop_node *const_op, int val, int *res);
+
+// Only checks the operators which are not known to be safe
+bool safe_eval_ast(const struct ast_node *ast, int *res);
+
+// Evaluate large trees on multiple threads, see `make_eval_pool`
+struct eval_pool;
+
+struct eval_pool *make_eval_pool(unsigned nb_threads, size_t cutoff);
+int pool_eval_ast(struct eval_pool *pool, const struct ast_node *ast);
+void destroy_eval_pool(struct eval_pool *pool);
+
+// Evaluate a tree on whole columns of variables, see `make_batch_eval`
+struct batch_eval;
+
+struct batch_eval *make_batch_eval(const struct ast_node *ast, bool safe);
+bool batch_eval(struct batch_eval *batch, const int *const *vars,
+                size_t nb_rows, int *res);
+void destroy_batch_eval(struct batch_eval *batch);
+
 #endif /* !EVAL_H */
@@ -0,0 +1,394 @@
+#include "eval.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define LOAD(Ptr) __atomic_load_n((Ptr), __ATOMIC_ACQUIRE)
+#define STORE(Ptr, Val) __atomic_store_n((Ptr), (Val), __ATOMIC_RELEASE)
+#define ADD(Ptr, Val) __atomic_add_fetch((Ptr), (Val), __ATOMIC_SEQ_CST)
+
+// Subtrees smaller than this are not worth a task of their own
+#define DEFAULT_CUTOFF 4096
+
+// Idle workers go to sleep after this many steals in a row found nothing
+#define MAX_FAILED_STEALS 64
+
+struct task
+{
+    const struct ast_node *ast;
+    int result;
+    int done;
+};
+
+/*
+ * Each worker owns a deque of tasks: it pushes and pops at the bottom, while
+ * other workers steal the oldest tasks at the top.
+ */
+struct worker
+{
+    struct eval_pool *pool;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    struct task **tasks;
+    size_t top;
+    size_t bottom;
+    size_t capacity;
+    unsigned seed; // Used to pick victims
+};
+
+struct eval_pool
+{
+    struct worker *workers;
+    unsigned nb_workers;
+    size_t cutoff;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int active; // Is there an evaluation going on
+    int shutdown;
+
+    /*
+     * Tasks waiting in the deques, and workers sleeping until there are some:
+     * each side updates its own counter before reading the other one, so that
+     * either the worker sees the task, or its owner sees the worker sleeping.
+     */
+    int nb_tasks;
+    int nb_sleeping;
+};
+
+static bool push_task(struct worker *worker, struct task *task)
+{
+    bool ret = true;
+
+    pthread_mutex_lock(&worker->lock);
+    if (worker->bottom == worker->capacity)
+    {
+        // Reclaim the space left by stolen tasks first
+        size_t len = worker->bottom - worker->top;
+        for (size_t i = 0; i < len; ++i)
+            worker->tasks[i] = worker->tasks[worker->top + i];
+        worker->top = 0;
+        worker->bottom = len;
+    }
+    if (worker->bottom == worker->capacity)
+    {
+        size_t capacity = worker->capacity ? worker->capacity * 2 : 64;
+        struct task **tasks =
+            realloc(worker->tasks, capacity * sizeof(*tasks));
+
+        if (tasks)
+        {
+            worker->tasks = tasks;
+            worker->capacity = capacity;
+        }
+        else
+            ret = false;
+    }
+    if (ret)
+        worker->tasks[worker->bottom++] = task;
+    pthread_mutex_unlock(&worker->lock);
+
+    struct eval_pool *pool = worker->pool;
+    if (ret)
+        ADD(&pool->nb_tasks, 1);
+    if (ret && ADD(&pool->nb_sleeping, 0) > 0)
+    {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return ret;
+}
+
+/*
+ * Take back the task if it has not been stolen in the meantime.
+ */
+static bool pop_task(struct worker *worker, struct task *task)
+{
+    bool ret = false;
+
+    pthread_mutex_lock(&worker->lock);
+    if (worker->bottom > worker->top
+        && worker->tasks[worker->bottom - 1] == task)
+    {
+        worker->bottom -= 1;
+        ret = true;
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    if (ret)
+        ADD(&worker->pool->nb_tasks, -1);
+
+    return ret;
+}
+
+static struct task *steal_task(struct worker *victim)
+{
+    struct task *ret = NULL;
+
+    if (pthread_mutex_trylock(&victim->lock))
+        return NULL; // Busy, try someone else
+
+    if (victim->bottom > victim->top)
+        ret = victim->tasks[victim->top++];
+    pthread_mutex_unlock(&victim->lock);
+
+    if (ret)
+        ADD(&victim->pool->nb_tasks, -1);
+
+    return ret;
+}
+
+static int eval_parallel(struct worker *worker, const struct ast_node *ast);
+
+static bool try_steal(struct worker *worker)
+{
+    struct eval_pool *pool = worker->pool;
+
+    // Simple xorshift to spread the thieves across victims
+    worker->seed ^= worker->seed << 13;
+    worker->seed ^= worker->seed >> 17;
+    worker->seed ^= worker->seed << 5;
+
+    unsigned start = worker->seed % pool->nb_workers;
+    for (unsigned i = 0; i < pool->nb_workers; ++i)
+    {
+        struct worker *victim = &pool->workers[(start + i) % pool->nb_workers];
+        if (victim == worker)
+            continue;
+
+        struct task *task = steal_task(victim);
+        if (task)
+        {
+            task->result = eval_parallel(worker, task->ast);
+            STORE(&task->done, 1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool worth_forking(const struct worker *worker,
+                          const struct binop_node *bin_op)
+{
+    size_t cutoff = worker->pool->cutoff;
+
+    // Only fork when both sides are worth it, e.g: not on `1 + 1 + 1 + ...`
+    return ast_size(bin_op->lhs) >= cutoff && ast_size(bin_op->rhs) >= cutoff;
+}
+
+/*
+ * Take back the task if it has not been stolen, or help the others while the
+ * thief finishes it.
+ */
+static int join_task(struct worker *worker, struct task *task)
+{
+    if (pop_task(worker, task))
+        return eval_parallel(worker, task->ast);
+
+    while (!LOAD(&task->done))
+        if (!try_steal(worker))
+            sched_yield();
+
+    return task->result;
+}
+
+/*
+ * Binary operators along the left spine are applied in a loop, like in
+ * `eval_ast`. Their right operands worth it are pushed as tasks on the way
+ * down, and joined in reverse order on the way up.
+ */
+static int eval_spine_parallel(struct worker *worker,
+                               const struct ast_node *ast)
+{
+    struct ast_spine spine;
+    init_spine(&spine);
+
+    const struct ast_node *node = walk_spine(&spine, ast);
+    if (node == NULL)
+        abort(); // Out of memory, with no way to report it
+
+    size_t nb_forks = 0;
+    for (size_t i = 0; i < spine.len; ++i)
+        nb_forks += worth_forking(worker, &spine.nodes[i]->val.bin_op);
+
+    // Evaluated serially if there is no memory for the tasks
+    struct task *tasks = nb_forks ? calloc(nb_forks, sizeof(*tasks)) : NULL;
+    size_t nb_tasks = 0;
+    for (size_t i = 0; tasks && i < spine.len; ++i)
+    {
+        const struct binop_node *bin_op = &spine.nodes[i]->val.bin_op;
+        if (!worth_forking(worker, bin_op))
+            continue;
+
+        tasks[nb_tasks].ast = bin_op->rhs;
+        if (push_task(worker, &tasks[nb_tasks]))
+            nb_tasks += 1;
+    }
+
+    int ret = eval_parallel(worker, node);
+    while ((node = pop_spine(&spine)))
+    {
+        const struct binop_node *bin_op = &node->val.bin_op;
+        int rhs;
+
+        if (nb_tasks > 0 && tasks[nb_tasks - 1].ast == bin_op->rhs)
+            rhs = join_task(worker, &tasks[--nb_tasks]);
+        else
+            rhs = eval_parallel(worker, bin_op->rhs);
+
+        ret = apply_binop(bin_op->op, ret, rhs);
+    }
+
+    free(tasks);
+    destroy_spine(&spine);
+    return ret;
+}
+
+static int eval_parallel(struct worker *worker, const struct ast_node *ast)
+{
+    if (ast->size < worker->pool->cutoff)
+        return eval_ast(ast);
+
+    switch (ast->kind)
+    {
+    case NODE_NUM:
+        return ast->val.num;
+    case NODE_VAR:
+    case NODE_LET:
+        break;
+    case NODE_UNOP:
+        return apply_unop(ast->val.un_op.op,
+                          eval_parallel(worker, ast->val.un_op.tree));
+    case NODE_BINOP:
+        return eval_spine_parallel(worker, ast);
+    case NODE_CONSTOP:
+        return apply_constop(&ast->val.const_op,
+                             eval_parallel(worker, ast->val.const_op.tree));
+    }
+    abort(); // Variables are only bound by `batch_eval`
+}
+
+static void *worker_loop(void *arg)
+{
+    struct worker *worker = arg;
+    struct eval_pool *pool = worker->pool;
+
+    while (true)
+    {
+        // Sleep until there is something to steal
+        pthread_mutex_lock(&pool->lock);
+        ADD(&pool->nb_sleeping, 1);
+        while (!LOAD(&pool->shutdown)
+               && (!LOAD(&pool->active) || ADD(&pool->nb_tasks, 0) == 0))
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        ADD(&pool->nb_sleeping, -1);
+        pthread_mutex_unlock(&pool->lock);
+
+        if (LOAD(&pool->shutdown))
+            return NULL;
+
+        // Tasks often come in bursts, keep looking for a little while
+        for (int failed = 0; LOAD(&pool->active) && failed < MAX_FAILED_STEALS;)
+        {
+            if (try_steal(worker))
+                failed = 0;
+            else
+            {
+                failed += 1;
+                sched_yield();
+            }
+        }
+    }
+}
+
+/*
+ * Thread pool evaluating independent subtrees in parallel, using work
+ * stealing. Subtrees with less than `cutoff` nodes are evaluated serially,
+ * a `cutoff` of 0 uses a sensible default.
+ */
+struct eval_pool *make_eval_pool(unsigned nb_threads, size_t cutoff)
+{
+    struct eval_pool *ret = calloc(1, sizeof(*ret));
+
+    if (ret == NULL)
+        return ret;
+
+    ret->nb_workers = nb_threads ? nb_threads : 1;
+    ret->cutoff = cutoff ? cutoff : DEFAULT_CUTOFF;
+    ret->workers = calloc(ret->nb_workers, sizeof(*ret->workers));
+    if (ret->workers == NULL)
+    {
+        free(ret);
+        return NULL;
+    }
+
+    pthread_mutex_init(&ret->lock, NULL);
+    pthread_cond_init(&ret->cond, NULL);
+
+    for (unsigned i = 0; i < ret->nb_workers; ++i)
+    {
+        ret->workers[i].pool = ret;
+        ret->workers[i].seed = 2463534242u + i;
+        pthread_mutex_init(&ret->workers[i].lock, NULL);
+    }
+
+    // The first worker is the thread calling `pool_eval_ast`
+    for (unsigned i = 1; i < ret->nb_workers; ++i)
+    {
+        if (pthread_create(&ret->workers[i].thread, NULL, worker_loop,
+                           &ret->workers[i]))
+        {
+            // Run with the threads which could be started
+            ret->nb_workers = i;
+            break;
+        }
+    }
+
+    return ret;
+}
+
+int pool_eval_ast(struct eval_pool *pool, const struct ast_node *ast)
+{
+    if (pool == NULL || pool->nb_workers == 1 || ast->size < pool->cutoff)
+        return eval_ast(ast);
+
+    pthread_mutex_lock(&pool->lock);
+    STORE(&pool->active, 1);
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    int ret = eval_parallel(&pool->workers[0], ast);
+
+    STORE(&pool->active, 0);
+
+    return ret;
+}
+
+void destroy_eval_pool(struct eval_pool *pool)
+{
+    if (pool == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    STORE(&pool->shutdown, 1);
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned i = 1; i < pool->nb_workers; ++i)
+        pthread_join(pool->workers[i].thread, NULL);
+
+    for (unsigned i = 0; i < pool->nb_workers; ++i)
+    {
+        pthread_mutex_destroy(&pool->workers[i].lock);
+        free(pool->workers[i].tasks);
+    }
+
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
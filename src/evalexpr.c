@@ -1,41 +1,551 @@
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "ast/ast.h"
 #include "eval/eval.h"
+#include "io/async_io.h"
+#include "io/columns.h"
+#include "io/shm_cache.h"
+#include "opt/opt.h"
 #include "parse/parse.h"
 
 #ifndef _USE_CLIMBING
 # define _USE_CLIMBING 0
 #endif
 
-int main(void)
+#define CHUNK_SIZE 65536
+#define BLOCK_ROWS 4096
+#define MAX_RANGES 64
+#define CACHE_SLOTS (1 << 16)
+
+// Used to parse and evaluate large expressions in parallel, when asked to
+static unsigned nb_threads = 1;
+static struct eval_pool *pool = NULL;
+
+// Used to read and write while parsing and evaluating, when asked to
+static struct async_io *async = NULL;
+
+// Report overflows and divisions by zero, instead of wrapping around
+static bool safe = false;
+
+// Results shared with the other processes, when asked to
+static struct shm_cache *cache = NULL;
+
+// Bounds declared for the values of the columns, checked when reading them
+struct column_range
+{
+    const char *name;
+    struct value_range range;
+};
+
+static struct column_range ranges[MAX_RANGES];
+static size_t nb_ranges = 0;
+
+static bool print_value(int res)
+{
+    if (async == NULL)
+    {
+        printf("%d\n", res);
+        return true;
+    }
+
+    char buf[16];
+    return async_write(async, buf, sprintf(buf, "%d\n", res));
+}
+
+/*
+ * Evaluate the tree and print its result, which is added to the cache under
+ * `key` unless it is NULL.
+ */
+static bool print_result(struct ast_node *ast, const struct expr_key *key)
+{
+    if (ast == NULL)
+    {
+        fputs("Could not parse input\n", stderr);
+        return false;
+    }
+
+    ast = specialize_ast(ast);
+
+    // Only the operators which could fail are checked
+    int res = 0;
+    bool ok = true;
+    if (safe)
+    {
+        analyze_ranges(ast, NULL, NULL);
+        ok = safe_eval_ast(ast, &res);
+    }
+    else
+        res = pool_eval_ast(pool, ast);
+    destroy_ast(ast);
+
+    if (!ok)
+    {
+        fputs("Overflow or division by zero\n", stderr);
+        return false;
+    }
+
+    if (key)
+        shm_cache_insert(cache, key, res);
+    return print_value(res);
+}
+
+/*
+ * Same as `print_result`, looking the result up in the cache first: only the
+ * evaluation is saved, the expression having been parsed already.
+ */
+static bool print_cached(struct ast_node *ast, const struct expr_key *key)
+{
+    int res;
+
+    if (cache == NULL)
+        return print_result(ast, NULL);
+
+    if (ast && shm_cache_lookup(cache, key, &res))
+    {
+        destroy_ast(ast);
+        return print_value(res);
+    }
+
+    return print_result(ast, key);
+}
+
+static int parse_lines(void)
 {
     char *line = NULL;
     size_t size = 0;
-    ssize_t ret = 0;
+    ssize_t len = 0;
+    int ret = 0;
 
-    while ((getline(&line, &size, stdin)) > 0)
+    while ((len = getline(&line, &size, stdin)) > 0)
     {
+        struct ast_node *ast = NULL;
+        struct expr_key key;
+        int res;
+
+        // Neither parsed nor evaluated if another process already did
+        if (cache)
+        {
+            init_expr_key(&key, safe);
+            hash_expr(&key, line, len);
+            if (shm_cache_lookup(cache, &key, &res))
+            {
+                if (!print_value(res))
+                    ret = 1;
+                continue;
+            }
+        }
+
+        if (nb_threads > 1)
+            ast = parallel_parse(line, nb_threads, 0);
+        else
 #if _USE_CLIMBING
-        struct ast_node *ast = climbing_parse(line);
+            ast = climbing_parse(line);
 #else
-        struct ast_node *ast = recursive_parse(line);
+            ast = recursive_parse(line);
 #endif
 
-        if (ast == NULL)
-        {
-            fputs("Could not parse input\n", stderr);
+        if (!print_result(ast, cache ? &key : NULL))
             ret = 1;
-            continue;
+    }
+
+    free(line);
+
+    return ret;
+}
+
+/*
+ * Feed a chunk of input to the streaming parser, printing the result of each
+ * line it completes. The line is hashed along, to be looked up in the cache.
+ */
+static int parse_chunk(struct stream_parser **parser, struct expr_key *key,
+                       const char *input, size_t len)
+{
+    int ret = 0;
+
+    while (len > 0)
+    {
+        const char *end = memchr(input, '\n', len);
+        size_t line_len = end ? (size_t)(end - input) + 1 : len;
+
+        if (*parser == NULL)
+        {
+            if ((*parser = make_stream_parser()) == NULL)
+                return 1;
+            init_expr_key(key, safe);
         }
 
-        printf("%d\n", eval_ast(ast));
+        // Errors are reported once the whole line has been read
+        stream_parse(*parser, input, line_len);
+        if (cache)
+            hash_expr(key, input, line_len);
 
-        destroy_ast(ast);
+        if (end)
+        {
+            if (!print_cached(finish_stream_parser(*parser), key))
+                ret = 1;
+            *parser = NULL;
+        }
+
+        input += line_len;
+        len -= line_len;
     }
 
-    free(line);
+    return ret;
+}
+
+/*
+ * Feed the input to the streaming parser in fixed-size chunks, to avoid
+ * buffering whole lines in memory.
+ */
+static int parse_stream(void)
+{
+    static char chunk[CHUNK_SIZE];
+    struct stream_parser *parser = NULL;
+    struct expr_key key;
+    size_t len = 0;
+    int ret = 0;
+
+    while ((len = fread(chunk, 1, sizeof(chunk), stdin)) > 0)
+        ret |= parse_chunk(&parser, &key, chunk, len);
+
+    // Last line, without a trailing newline
+    if (parser && !print_cached(finish_stream_parser(parser), &key))
+        ret = 1;
+
+    return ret;
+}
+
+/*
+ * Same as `parse_stream`, the next chunks being read while the current one is
+ * parsed, and the results being written out in the background.
+ */
+static int parse_async(void)
+{
+    struct stream_parser *parser = NULL;
+    struct expr_key key;
+    const char *chunk = NULL;
+    size_t len = 0;
+    int ret = 0;
+
+    while ((chunk = async_read(async, &len)) != NULL)
+        ret |= parse_chunk(&parser, &key, chunk, len);
+
+    // Last line, without a trailing newline
+    if (parser && !print_cached(finish_stream_parser(parser), &key))
+        ret = 1;
+
+    return ret;
+}
+
+/*
+ * The bounds of each column, all values being possible in those which were not
+ * given any.
+ */
+static struct value_range *column_ranges(const struct column_reader *reader)
+{
+    const size_t nb_columns = column_count(reader);
+    const char *const *names = column_names(reader);
+    struct value_range *ret = malloc(nb_columns * sizeof(*ret));
+
+    if (ret == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < nb_columns; ++i)
+    {
+        ret[i].min = INT_MIN;
+        ret[i].max = INT_MAX;
+    }
+
+    for (size_t i = 0; i < nb_ranges; ++i)
+    {
+        size_t column = 0;
+        while (column < nb_columns && strcmp(names[column], ranges[i].name))
+            column += 1;
+
+        if (column == nb_columns)
+        {
+            fprintf(stderr, "Unknown column: %s\n", ranges[i].name);
+            free(ret);
+            return NULL;
+        }
+        ret[column] = ranges[i].range;
+    }
+
+    return ret;
+}
+
+static bool in_ranges(const struct value_range *bounds,
+                      const int *const *columns, size_t nb_columns,
+                      size_t nb_rows)
+{
+    bool ret = true;
+
+    for (size_t i = 0; i < nb_columns; ++i)
+        for (size_t j = 0; j < nb_rows; ++j)
+            ret &= columns[i][j] >= bounds[i].min
+                && columns[i][j] <= bounds[i].max;
+
+    return ret;
+}
+
+/*
+ * Evaluate the formula on each row of the input, its variables being bound to
+ * the columns of the same name. The formula is parsed once, and evaluated on
+ * blocks of rows.
+ *
+ * With safe arithmetic, the bounds declared for the columns let the checks on
+ * the operators which cannot fail be elided.
+ */
+static int eval_columns(const char *formula, enum column_format format)
+{
+    const char *error = NULL;
+    struct column_reader *reader = make_column_reader(stdin, format, &error);
+    if (reader == NULL)
+    {
+        fprintf(stderr, "Could not read the columns: %s\n", error);
+        return 1;
+    }
+
+    const size_t nb_columns = column_count(reader);
+    struct value_range *bounds = column_ranges(reader);
+    struct ast_node *ast = specialize_ast(
+        recursive_parse_vars(formula, column_names(reader), nb_columns));
+    const bool parsed = ast != NULL;
+
+    if (ast && bounds && safe)
+        analyze_ranges(ast, bounds, NULL);
+
+    struct batch_eval *batch = make_batch_eval(ast, safe);
+    int *memory = malloc((nb_columns + 1) * BLOCK_ROWS * sizeof(*memory));
+    int **columns = malloc(nb_columns * sizeof(*columns));
+    int ret = 1;
+
+    destroy_ast(ast); // Not needed once compiled
+
+    if (!parsed)
+        fputs("Could not parse the formula\n", stderr);
+    else if (bounds && batch && memory && columns
+             && write_column_header(stdout, format, "result"))
+    {
+        int *res = memory + nb_columns * BLOCK_ROWS;
+        size_t nb_rows = 0;
+
+        for (size_t i = 0; i < nb_columns; ++i)
+            columns[i] = memory + i * BLOCK_ROWS;
+
+        ret = 0;
+        while (!ret && (nb_rows = read_columns(reader, columns, BLOCK_ROWS)))
+        {
+            const int *const *vars = (const int *const *)columns;
+
+            if (!in_ranges(bounds, vars, nb_columns, nb_rows))
+            {
+                fputs("Value out of its declared range\n", stderr);
+                ret = 1;
+            }
+            else if (!batch_eval(batch, vars, nb_rows, res))
+            {
+                fputs("Overflow or division by zero\n", stderr);
+                ret = 1;
+            }
+            else
+                ret = !write_column(stdout, format, res, nb_rows);
+        }
+    }
+
+    if (!destroy_column_reader(reader))
+    {
+        fputs("Could not read the columns\n", stderr);
+        ret = 1;
+    }
+
+    free(columns);
+    free(memory);
+    free(bounds);
+    destroy_batch_eval(batch);
+
+    return ret;
+}
+
+static bool parse_backend(const char *name, enum io_backend *backend)
+{
+    static const char *const names[] = {
+        [IO_AUTO] = "auto",
+        [IO_URING] = "uring",
+        [IO_EPOLL] = "epoll",
+    };
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(*names); ++i)
+    {
+        if (strcmp(name, names[i]) == 0)
+        {
+            *backend = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Declare the bounds of a column, as `name=min:max`.
+ */
+static bool parse_range(char *arg)
+{
+    char *sep = strchr(arg, '=');
+    char *begin = sep + 1;
+    char *end = NULL;
+
+    if (sep == NULL || sep == arg || nb_ranges == MAX_RANGES)
+        return false;
+
+    long min = strtol(begin, &end, 10);
+    if (end == begin || *end != ':')
+        return false;
+
+    begin = end + 1;
+    long max = strtol(begin, &end, 10);
+    if (end == begin || *end != '\0' || min > max || min < INT_MIN
+        || max > INT_MAX)
+        return false;
+
+    *sep = '\0';
+    ranges[nb_ranges].name = arg;
+    ranges[nb_ranges].range.min = min;
+    ranges[nb_ranges].range.max = max;
+    nb_ranges += 1;
+
+    return true;
+}
+
+static void print_cache_stats(void)
+{
+    struct cache_stats local;
+    struct cache_stats shared;
+
+    shm_cache_stats(cache, &local, &shared);
+    fprintf(stderr,
+            "Cache: %" PRIu64 " hits, %" PRIu64 " misses (%.1f%%)\n"
+            "Cache, all processes: %" PRIu64 " hits, %" PRIu64
+            " misses (%.1f%%), %" PRIu64 " inserts, %" PRIu64
+            " evictions, %" PRIu64 " reclaimed\n",
+            local.hits, local.misses,
+            100. * local.hits / (local.hits + local.misses + !local.hits),
+            shared.hits, shared.misses,
+            100. * shared.hits / (shared.hits + shared.misses + !shared.hits),
+            shared.inserts, shared.evictions, shared.reclaims);
+}
+
+static int usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-a auto|uring|epoll] [-j threads] [-c] [-m /name] "
+            "[-s]\n"
+            "       %s -e formula [-b] [-c] [-r name=min:max]...\n",
+            name, name);
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    bool stream = false;
+    bool use_async = false;
+    const char *formula = NULL;
+    const char *cache_name = NULL;
+    enum column_format format = COLUMNS_CSV;
+    enum io_backend backend = IO_AUTO;
+    unsigned long threads = 1;
+    char *end = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:bce:j:m:r:s")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a':
+            use_async = true;
+            if (!parse_backend(optarg, &backend))
+                return usage(argv[0]);
+            break;
+        case 'b':
+            format = COLUMNS_BINARY;
+            break;
+        case 'c':
+            safe = true;
+            break;
+        case 'e':
+            formula = optarg;
+            break;
+        case 'm':
+            cache_name = optarg;
+            break;
+        case 'r':
+            if (!parse_range(optarg))
+                return usage(argv[0]);
+            break;
+        case 's':
+            stream = true;
+            break;
+        case 'j':
+            threads = strtoul(optarg, &end, 10);
+            if (*end == '\0' && threads > 0 && threads <= 1024)
+                break;
+            /* FALLTHROUGH */
+        default:
+            return usage(argv[0]);
+        }
+    }
+
+    // Formulas are evaluated on blocks of rows, on a single thread
+    if (formula && (stream || use_async || threads > 1 || cache_name))
+        return usage(argv[0]);
+    if (formula)
+        return eval_columns(formula, format);
+    if (format != COLUMNS_CSV || nb_ranges > 0)
+        return usage(argv[0]);
+
+    if (cache_name && (cache = make_shm_cache(cache_name, CACHE_SLOTS)) == NULL)
+    {
+        fputs("Could not open the cache\n", stderr);
+        return 1;
+    }
+
+    nb_threads = threads;
+    if (threads > 1 && (pool = make_eval_pool(threads, 0)) == NULL)
+    {
+        destroy_shm_cache(cache);
+        return 1;
+    }
+
+    if (use_async)
+        async = make_async_io(STDIN_FILENO, STDOUT_FILENO, backend);
+    if (use_async && async == NULL)
+    {
+        fputs("Could not set up asynchronous I/O\n", stderr);
+        destroy_eval_pool(pool);
+        destroy_shm_cache(cache);
+        return 1;
+    }
+
+    int ret = 0;
+    if (async)
+        ret = parse_async();
+    else
+        ret = stream ? parse_stream() : parse_lines();
+
+    if (!destroy_async_io(async))
+        ret = 1;
+    destroy_eval_pool(pool);
+
+    if (cache)
+        print_cache_stats();
+    destroy_shm_cache(cache);
 
     return ret;
 }
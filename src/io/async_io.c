@@ -0,0 +1,763 @@
+#define _GNU_SOURCE // For `syscall`
+
+#include "async_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define NB_READS 4
+#define NB_WRITES 4
+#define BUFFER_SIZE (1 << 16)
+
+#define LOAD(Ptr) __atomic_load_n((Ptr), __ATOMIC_ACQUIRE)
+#define STORE(Ptr, Val) __atomic_store_n((Ptr), (Val), __ATOMIC_RELEASE)
+
+struct request
+{
+    struct request *next; // Used by the backends to queue requests
+    int fd;
+    bool write;
+    char *data;
+    size_t len;
+    off_t off; // -1 to use, and update, the current file position
+    long res; // Number of bytes, or negated `errno`
+    bool pending;
+};
+
+struct buffer
+{
+    struct request req;
+    char *data;
+    size_t len; // Bytes read, or bytes to be written
+    size_t done; // Bytes already written
+    bool submitted;
+};
+
+struct uring
+{
+    int fd;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned to_submit;
+};
+
+/*
+ * Requests are queued per file, only the first one of each queue is executed,
+ * using non-blocking I/O on the files which can be polled.
+ */
+struct epoll
+{
+    int fd;
+    struct
+    {
+        int fd; // Our own non-blocking descriptor, when polled
+        bool polled;
+        struct request *head;
+        struct request *tail;
+    } files[2];
+};
+
+struct backend
+{
+    const char *name;
+    bool (*init)(struct async_io *io);
+    void (*submit)(struct async_io *io, struct request *req);
+    bool (*flush)(struct async_io *io); // Start the submitted requests
+    bool (*wait)(struct async_io *io); // Wait for at least one completion
+    void (*cancel)(struct async_io *io, struct request *req);
+    void (*fini)(struct async_io *io);
+};
+
+struct async_io
+{
+    const struct backend *backend;
+    int in_fd;
+    int out_fd;
+    char *memory;
+
+    // Regular files are read at explicit offsets, several reads at once
+    bool seekable;
+    off_t offset; // Of the next read to be submitted
+
+    // Buffers are used in order, indices are modulo the number of buffers
+    struct buffer reads[NB_READS];
+    size_t read_head; // First buffer to be returned
+    size_t read_tail; // First buffer not yet submitted
+    bool holding; // Is the first buffer in the hands of the user
+    bool finished; // A read of the stream returned nothing, none comes next
+    bool eof;
+
+    struct buffer writes[NB_WRITES];
+    size_t write_head; // First buffer waiting to be written
+    size_t write_tail; // Buffer being filled
+
+    bool error;
+
+    union
+    {
+        struct uring uring;
+        struct epoll epoll;
+    } state;
+};
+
+static struct buffer *read_buffer(struct async_io *io, size_t index)
+{
+    return &io->reads[index % NB_READS];
+}
+
+static struct buffer *write_buffer(struct async_io *io, size_t index)
+{
+    return &io->writes[index % NB_WRITES];
+}
+
+static void prepare(struct request *req, int fd, bool write, char *data,
+                    size_t len, off_t off)
+{
+    req->next = NULL;
+    req->fd = fd;
+    req->write = write;
+    req->data = data;
+    req->len = len;
+    req->off = off;
+    req->res = 0;
+    req->pending = true;
+}
+
+static bool uring_init(struct async_io *io)
+{
+    struct uring *uring = &io->state.uring;
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+    uring->fd = syscall(__NR_io_uring_setup, NB_READS + NB_WRITES, &params);
+    if (uring->fd < 0)
+        return false;
+
+    uring->sq_ring_size = params.sq_off.array
+                          + params.sq_entries * sizeof(unsigned);
+    uring->cq_ring_size = params.cq_off.cqes
+                          + params.cq_entries * sizeof(struct io_uring_cqe);
+    uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, uring->fd, IORING_OFF_SQ_RING);
+    uring->cq_ring = mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, uring->fd, IORING_OFF_CQ_RING);
+    uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, uring->fd, IORING_OFF_SQES);
+
+    if (uring->sq_ring == MAP_FAILED || uring->cq_ring == MAP_FAILED
+        || uring->sqes == MAP_FAILED)
+    {
+        if (uring->sq_ring != MAP_FAILED)
+            munmap(uring->sq_ring, uring->sq_ring_size);
+        if (uring->cq_ring != MAP_FAILED)
+            munmap(uring->cq_ring, uring->cq_ring_size);
+        if (uring->sqes != MAP_FAILED)
+            munmap(uring->sqes, uring->sqes_size);
+        close(uring->fd);
+        return false;
+    }
+
+    char *sq = uring->sq_ring;
+    uring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    uring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    uring->sq_array = (unsigned *)(sq + params.sq_off.array);
+
+    char *cq = uring->cq_ring;
+    uring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    uring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    uring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    uring->to_submit = 0;
+
+    return true;
+}
+
+static void uring_submit(struct async_io *io, struct request *req)
+{
+    struct uring *uring = &io->state.uring;
+    // There are never more requests than buffers, the ring cannot be full
+    unsigned tail = *uring->sq_tail;
+    unsigned index = tail & *uring->sq_mask;
+    struct io_uring_sqe *sqe = &uring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = req->write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = req->fd;
+    sqe->off = req->off;
+    sqe->addr = (uintptr_t)req->data;
+    sqe->len = req->len;
+    sqe->user_data = (uintptr_t)req;
+
+    uring->sq_array[index] = index;
+    STORE(uring->sq_tail, tail + 1);
+    uring->to_submit += 1;
+}
+
+static bool uring_enter(struct uring *uring, unsigned min_complete)
+{
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+
+    while (uring->to_submit > 0 || min_complete > 0)
+    {
+        long ret = syscall(__NR_io_uring_enter, uring->fd, uring->to_submit,
+                           min_complete, flags, NULL, 0);
+        if (ret < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            return false;
+        }
+
+        uring->to_submit -= ret;
+        if (min_complete > 0 && uring->to_submit == 0)
+            break;
+    }
+
+    return true;
+}
+
+static bool uring_flush(struct async_io *io)
+{
+    return uring_enter(&io->state.uring, 0);
+}
+
+static bool uring_wait(struct async_io *io)
+{
+    struct uring *uring = &io->state.uring;
+    unsigned head = *uring->cq_head;
+
+    if (head == LOAD(uring->cq_tail) && !uring_enter(uring, 1))
+        return false;
+
+    for (unsigned tail = LOAD(uring->cq_tail); head != tail; ++head)
+    {
+        struct io_uring_cqe *cqe = &uring->cqes[head & *uring->cq_mask];
+        struct request *req = (struct request *)(uintptr_t)cqe->user_data;
+
+        if (req == NULL)
+            continue; // Cancellation requests
+        req->res = cqe->res;
+        req->pending = false;
+    }
+    STORE(uring->cq_head, head);
+
+    return true;
+}
+
+static void uring_cancel(struct async_io *io, struct request *req)
+{
+    struct uring *uring = &io->state.uring;
+    unsigned tail = *uring->sq_tail;
+    unsigned index = tail & *uring->sq_mask;
+    struct io_uring_sqe *sqe = &uring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uintptr_t)req;
+    sqe->user_data = 0;
+
+    uring->sq_array[index] = index;
+    STORE(uring->sq_tail, tail + 1);
+    uring->to_submit += 1;
+}
+
+static void uring_fini(struct async_io *io)
+{
+    struct uring *uring = &io->state.uring;
+
+    munmap(uring->sqes, uring->sqes_size);
+    munmap(uring->cq_ring, uring->cq_ring_size);
+    munmap(uring->sq_ring, uring->sq_ring_size);
+    close(uring->fd);
+}
+
+/*
+ * The flags of a descriptor belong to its open file description, which is
+ * shared with the other processes using it, e.g: the rest of the pipeline.
+ * Pipes are opened again instead, to get a non-blocking description of our
+ * own: other files, sockets included, use blocking calls.
+ */
+static int open_nonblocking(int fd, bool write)
+{
+    struct stat st;
+    char path[32];
+
+    if (fstat(fd, &st) || !S_ISFIFO(st.st_mode))
+        return -1;
+
+    sprintf(path, "/proc/self/fd/%d", fd);
+    return open(path, (write ? O_WRONLY : O_RDONLY) | O_NONBLOCK | O_CLOEXEC);
+}
+
+static bool epoll_init(struct async_io *io)
+{
+    struct epoll *epoll = &io->state.epoll;
+    const int fds[] = { io->in_fd, io->out_fd };
+
+    epoll->fd = epoll_create1(0);
+    for (size_t i = 0; i < 2; ++i)
+    {
+        epoll->files[i].fd = fds[i];
+        epoll->files[i].polled = false;
+        epoll->files[i].head = NULL;
+        epoll->files[i].tail = NULL;
+
+        int fd = epoll->fd < 0 ? -1 : open_nonblocking(fds[i], i);
+        if (fd < 0)
+            continue;
+
+        struct epoll_event event = { .events = 0, .data.u32 = i };
+        if (epoll_ctl(epoll->fd, EPOLL_CTL_ADD, fd, &event))
+        {
+            close(fd);
+            continue;
+        }
+
+        epoll->files[i].fd = fd;
+        epoll->files[i].polled = true;
+    }
+
+    return true;
+}
+
+static void epoll_submit(struct async_io *io, struct request *req)
+{
+    struct epoll *epoll = &io->state.epoll;
+    size_t i = req->write;
+
+    if (epoll->files[i].tail)
+        epoll->files[i].tail->next = req;
+    else
+        epoll->files[i].head = req;
+    epoll->files[i].tail = req;
+}
+
+/*
+ * Returns true if the first request of the file was completed.
+ */
+static bool epoll_try(struct epoll *epoll, size_t i)
+{
+    struct request *req = epoll->files[i].head;
+
+    if (req == NULL)
+        return false;
+
+    int fd = epoll->files[i].fd;
+    ssize_t res;
+    do
+    {
+        if (req->write)
+            res = write(fd, req->data, req->len);
+        else if (req->off >= 0)
+            res = pread(fd, req->data, req->len, req->off);
+        else
+            res = read(fd, req->data, req->len);
+    } while (res < 0 && errno == EINTR);
+
+    if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return false;
+
+    req->res = res < 0 ? -errno : res;
+    req->pending = false;
+
+    epoll->files[i].head = req->next;
+    if (epoll->files[i].head == NULL)
+        epoll->files[i].tail = NULL;
+
+    return true;
+}
+
+static bool epoll_flush(struct async_io *io)
+{
+    struct epoll *epoll = &io->state.epoll;
+
+    // Do as much as possible without blocking
+    for (size_t i = 0; i < 2; ++i)
+        while (epoll->files[i].polled && epoll_try(epoll, i))
+            continue;
+
+    return true;
+}
+
+static bool epoll_wait_completion(struct async_io *io)
+{
+    struct epoll *epoll = &io->state.epoll;
+
+    while (true)
+    {
+        bool done = false;
+
+        // Writes first, so that whoever reads our output is not kept waiting
+        for (size_t i = 2; i > 0; --i)
+            done |= epoll_try(epoll, i - 1);
+        if (done)
+            return true;
+
+        bool polling = false;
+        for (size_t i = 0; i < 2; ++i)
+        {
+            if (!epoll->files[i].polled)
+                continue;
+
+            struct epoll_event event = { .events = 0, .data.u32 = i };
+            if (epoll->files[i].head)
+                event.events = i ? EPOLLOUT : EPOLLIN;
+            polling |= event.events != 0;
+            if (epoll_ctl(epoll->fd, EPOLL_CTL_MOD, epoll->files[i].fd, &event))
+                return false;
+        }
+
+        // Everything was completed while flushing, nothing to wait for
+        if (!polling)
+            return true;
+
+        struct epoll_event events[2];
+        if (epoll_wait(epoll->fd, events, 2, -1) < 0 && errno != EINTR)
+            return false;
+    }
+}
+
+static void epoll_cancel(struct async_io *io, struct request *req)
+{
+    struct epoll *epoll = &io->state.epoll;
+    size_t i = req->write;
+
+    // Requests are never started in the background, drop the whole queue
+    for (struct request *it = epoll->files[i].head; it; it = it->next)
+        it->pending = false;
+    epoll->files[i].head = NULL;
+    epoll->files[i].tail = NULL;
+}
+
+static void epoll_fini(struct async_io *io)
+{
+    struct epoll *epoll = &io->state.epoll;
+
+    for (size_t i = 0; i < 2; ++i)
+        if (epoll->files[i].polled)
+            close(epoll->files[i].fd);
+
+    if (epoll->fd >= 0)
+        close(epoll->fd);
+}
+
+static const struct backend backends[] = {
+    [IO_URING] = { "io_uring", uring_init, uring_submit, uring_flush,
+                   uring_wait, uring_cancel, uring_fini },
+    [IO_EPOLL] = { "epoll", epoll_init, epoll_submit, epoll_flush,
+                   epoll_wait_completion, epoll_cancel, epoll_fini },
+};
+
+static bool is_retry(long res)
+{
+    return res == -ECANCELED || res == -EINTR || res == -EAGAIN;
+}
+
+/*
+ * Regular files are read at explicit offsets, the free buffers being filled
+ * at once when there are enough of them, to submit them together. Reads of
+ * pipes and sockets have to happen in order, and are mostly short: only one of
+ * them is in flight, the next one being submitted as soon as it is done, while
+ * the buffers already filled wait to be returned.
+ */
+static void submit_reads(struct async_io *io)
+{
+    // The end of a stream, which may go on, e.g: a terminal after ^D
+    if (!io->seekable && io->read_tail > io->read_head)
+    {
+        const struct request *last = &read_buffer(io, io->read_tail - 1)->req;
+
+        io->finished |= !last->pending && last->res == 0;
+    }
+
+    if (io->eof || io->error || io->finished)
+        return;
+
+    bool submitted = false;
+
+    // Interrupted reads are submitted again, at the same offset
+    for (size_t i = io->read_head; i < io->read_tail; ++i)
+    {
+        struct buffer *buf = read_buffer(io, i);
+
+        if (!buf->req.pending && is_retry(buf->req.res))
+        {
+            prepare(&buf->req, io->in_fd, false, buf->data, BUFFER_SIZE,
+                    buf->req.off);
+            io->backend->submit(io, &buf->req);
+            submitted = true;
+        }
+    }
+
+    size_t end = io->read_head + NB_READS;
+    if (io->seekable && io->read_tail > io->read_head
+        && end - io->read_tail < NB_READS / 2)
+        end = io->read_tail; // Wait for more buffers to be free
+
+    for (; io->read_tail < end; ++io->read_tail)
+    {
+        struct buffer *buf = read_buffer(io, io->read_tail);
+
+        // Only one read of a stream at a time
+        if (!io->seekable && io->read_tail > io->read_head
+            && read_buffer(io, io->read_tail - 1)->req.pending)
+            break;
+
+        prepare(&buf->req, io->in_fd, false, buf->data, BUFFER_SIZE,
+                io->seekable ? io->offset : -1);
+        io->backend->submit(io, &buf->req);
+        io->offset += BUFFER_SIZE;
+        submitted = true;
+    }
+
+    if (submitted && !io->backend->flush(io))
+        io->error = true;
+}
+
+/*
+ * Writes are submitted one buffer at a time, to keep them in order.
+ */
+static void submit_writes(struct async_io *io)
+{
+    while (!io->error && io->write_head < io->write_tail)
+    {
+        struct buffer *buf = write_buffer(io, io->write_head);
+
+        if (buf->req.pending)
+            return; // Still being written
+
+        if (buf->submitted)
+        {
+            buf->submitted = false;
+            if (buf->req.res > 0)
+                buf->done += buf->req.res;
+            else if (!is_retry(buf->req.res))
+                io->error = true;
+            continue;
+        }
+
+        if (buf->done < buf->len)
+        {
+            prepare(&buf->req, io->out_fd, true, buf->data + buf->done,
+                    buf->len - buf->done, -1);
+            io->backend->submit(io, &buf->req);
+            buf->submitted = true;
+            if (!io->backend->flush(io))
+                io->error = true;
+            continue; // It may have been written already
+        }
+
+        // Fully written, ready to be filled again
+        buf->len = 0;
+        buf->done = 0;
+        io->write_head += 1;
+    }
+}
+
+/*
+ * Wait for some requests to complete, and start the next ones.
+ */
+static bool progress(struct async_io *io)
+{
+    if (!io->error && !io->backend->wait(io))
+        io->error = true;
+
+    submit_writes(io);
+    submit_reads(io);
+
+    return !io->error;
+}
+
+/*
+ * Read and write asynchronously, while the data is being processed: input is
+ * read ahead in multiple buffers, output is written out once buffers are
+ * full.
+ */
+struct async_io *make_async_io(int in_fd, int out_fd, enum io_backend backend)
+{
+    struct async_io *ret = calloc(1, sizeof(*ret));
+
+    if (ret == NULL)
+        return NULL;
+
+    ret->in_fd = in_fd;
+    ret->out_fd = out_fd;
+
+    struct stat st;
+    if (fstat(in_fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        ret->offset = lseek(in_fd, 0, SEEK_CUR);
+        ret->seekable = ret->offset >= 0;
+    }
+    ret->memory = malloc((NB_READS + NB_WRITES) * BUFFER_SIZE);
+    if (ret->memory == NULL)
+    {
+        free(ret);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < NB_READS; ++i)
+        ret->reads[i].data = ret->memory + i * BUFFER_SIZE;
+    for (size_t i = 0; i < NB_WRITES; ++i)
+        ret->writes[i].data = ret->memory + (NB_READS + i) * BUFFER_SIZE;
+
+    for (size_t i = IO_URING; i < sizeof(backends) / sizeof(*backends); ++i)
+    {
+        if (backend != IO_AUTO && backend != i)
+            continue;
+        if (backends[i].init(ret))
+        {
+            ret->backend = &backends[i];
+            break;
+        }
+    }
+
+    if (ret->backend == NULL)
+    {
+        free(ret->memory);
+        free(ret);
+        return NULL;
+    }
+
+    return ret;
+}
+
+const char *async_io_backend(const struct async_io *io)
+{
+    return io->backend->name;
+}
+
+const char *async_read(struct async_io *io, size_t *len)
+{
+    if (io->holding)
+    {
+        io->read_head += 1;
+        io->holding = false;
+    }
+
+    while (!io->error && !io->eof)
+    {
+        submit_reads(io);
+        if (io->read_head == io->read_tail)
+            return NULL; // At the end of input
+
+        struct buffer *buf = read_buffer(io, io->read_head);
+        if (buf->req.pending || is_retry(buf->req.res))
+        {
+            progress(io);
+            continue;
+        }
+
+        if (buf->req.res < 0)
+        {
+            io->error = true;
+            break;
+        }
+
+        if (buf->req.res == 0)
+        {
+            io->eof = true;
+            break;
+        }
+
+        // The end of a regular file, the reads after it are not needed
+        if (io->seekable && (size_t)buf->req.res < buf->req.len)
+            io->eof = true;
+
+        io->holding = true;
+        *len = buf->req.res;
+        return buf->data;
+    }
+
+    return NULL;
+}
+
+bool async_write(struct async_io *io, const char *data, size_t len)
+{
+    while (!io->error && len > 0)
+    {
+        struct buffer *buf = write_buffer(io, io->write_tail);
+        size_t size = BUFFER_SIZE - buf->len;
+
+        if (size > len)
+            size = len;
+        memcpy(buf->data + buf->len, data, size);
+        buf->len += size;
+        data += size;
+        len -= size;
+
+        if (buf->len < BUFFER_SIZE)
+            break;
+
+        // Queue the full buffer, wait for the next one to be available
+        io->write_tail += 1;
+        submit_writes(io);
+        while (io->write_tail - io->write_head >= NB_WRITES && progress(io))
+            continue;
+    }
+
+    return !io->error;
+}
+
+bool destroy_async_io(struct async_io *io)
+{
+    if (io == NULL)
+        return true;
+
+    // Flush the last buffer
+    if (write_buffer(io, io->write_tail)->len > 0)
+        io->write_tail += 1;
+    submit_writes(io);
+    while (io->write_head < io->write_tail && progress(io))
+        continue;
+
+    bool ret = !io->error;
+
+    // Make sure the kernel is done with our buffers, e.g: after an error
+    for (size_t i = 0; i < NB_READS + NB_WRITES; ++i)
+    {
+        struct buffer *buf = i < NB_READS ? &io->reads[i]
+                                          : &io->writes[i - NB_READS];
+        if (buf->req.pending)
+            io->backend->cancel(io, &buf->req);
+    }
+    for (size_t i = 0; i < NB_READS + NB_WRITES; ++i)
+    {
+        struct buffer *buf = i < NB_READS ? &io->reads[i]
+                                          : &io->writes[i - NB_READS];
+        while (buf->req.pending && io->backend->flush(io)
+               && io->backend->wait(io))
+            continue;
+    }
+
+    io->backend->fini(io);
+    free(io->memory);
+    free(io);
+
+    return ret;
+}
@@ -0,0 +1,31 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Forward declaration
+struct async_io;
+
+enum io_backend
+{
+    IO_AUTO, // The first one which is available, in the order below
+    IO_URING,
+    IO_EPOLL, // Blocking reads and writes on files which cannot be polled
+};
+
+struct async_io *make_async_io(int in_fd, int out_fd, enum io_backend backend);
+
+// Name of the backend in use
+const char *async_io_backend(const struct async_io *io);
+
+// Returns NULL at the end of input, the data is valid until the next call
+const char *async_read(struct async_io *io, size_t *len);
+
+// Returns false on errors, the data is copied before being written out
+bool async_write(struct async_io *io, const char *data, size_t len);
+
+// Flushes the output, returns false if any error happened
+bool destroy_async_io(struct async_io *io);
+
+#endif /* !ASYNC_IO_H */
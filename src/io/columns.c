@@ -0,0 +1,439 @@
+#include "columns.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parse/scan.h"
+
+#define CHUNK_SIZE (1 << 16)
+
+// Binary blocks bigger than this are considered invalid
+#define MAX_BLOCK_ROWS (1 << 20)
+
+struct column_reader
+{
+    FILE *in;
+    enum column_format format;
+    char **names;
+    size_t nb_columns;
+    bool error;
+
+    // Input not parsed yet, NUL-terminated for the scanning kernels
+    char *buf;
+    size_t capacity;
+    size_t begin;
+    size_t end;
+    bool eof;
+
+    // Binary block being read, column after column
+    int32_t *block;
+    size_t block_capacity;
+    size_t block_rows;
+    size_t block_pos; // Rows already returned
+};
+
+/*
+ * Read more input, keeping what was not parsed yet. Returns false if nothing
+ * more could be read.
+ */
+static bool fill(struct column_reader *reader)
+{
+    if (reader->eof)
+        return false;
+
+    size_t len = reader->end - reader->begin;
+    if (len > 0) // Nothing was allocated before the first call
+        memmove(reader->buf, reader->buf + reader->begin, len);
+    reader->begin = 0;
+    reader->end = len;
+
+    if (reader->capacity - len < CHUNK_SIZE + 1)
+    {
+        size_t capacity = reader->capacity ? reader->capacity * 2 : CHUNK_SIZE;
+        while (capacity - len < CHUNK_SIZE + 1)
+            capacity *= 2;
+
+        char *buf = realloc(reader->buf, capacity);
+        if (buf == NULL)
+        {
+            reader->error = true;
+            return false;
+        }
+        reader->buf = buf;
+        reader->capacity = capacity;
+    }
+
+    size_t res = fread(reader->buf + len, 1, CHUNK_SIZE, reader->in);
+    reader->end += res;
+    reader->buf[reader->end] = '\0';
+
+    if (res == 0)
+    {
+        reader->eof = true;
+        reader->error |= ferror(reader->in) != 0;
+    }
+
+    return res > 0;
+}
+
+/*
+ * Returns the next line, without its newline, or NULL at the end of input.
+ * The line is valid until the next call.
+ */
+static char *next_line(struct column_reader *reader)
+{
+    char *newline = NULL;
+
+    while ((newline = memchr(reader->buf + reader->begin, '\n',
+                             reader->end - reader->begin))
+           == NULL)
+    {
+        if (!fill(reader))
+            break;
+    }
+
+    if (reader->begin == reader->end)
+        return NULL;
+
+    char *line = reader->buf + reader->begin;
+    char *line_end = newline ? newline : reader->buf + reader->end;
+
+    reader->begin = line_end - reader->buf + (newline != NULL);
+    if (line_end > line && line_end[-1] == '\r')
+        line_end -= 1;
+    *line_end = '\0';
+
+    return line;
+}
+
+static const char *skip_blanks(const char *input)
+{
+    while (*input == ' ' || *input == '\t')
+        input += 1;
+    return input;
+}
+
+static bool same_name(const char *name, const char *begin, const char *end)
+{
+    return strncmp(name, begin, end - begin) == 0 && name[end - begin] == '\0';
+}
+
+static const char *read_header(struct column_reader *reader)
+{
+    const char *line = next_line(reader);
+
+    if (line == NULL)
+        return "Missing header";
+
+    reader->nb_columns = 1;
+    for (const char *it = line; (it = strchr(it, ',')) != NULL; ++it)
+        reader->nb_columns += 1;
+
+    if ((reader->names = calloc(reader->nb_columns, sizeof(char *))) == NULL)
+        return "Out of memory";
+
+    for (size_t i = 0; i < reader->nb_columns; ++i)
+    {
+        const char *begin = skip_blanks(line);
+        const char *end = strchr(begin, ',');
+
+        line = end ? end + 1 : begin + strlen(begin);
+        if (end == NULL)
+            end = line;
+        while (end > begin && (end[-1] == ' ' || end[-1] == '\t'))
+            end -= 1;
+        if (end == begin)
+            return "Unnamed column";
+
+        // A variable would be bound to either of them
+        for (size_t j = 0; j < i; ++j)
+        {
+            if (same_name(reader->names[j], begin, end))
+                return "Duplicate column name";
+        }
+
+        if ((reader->names[i] = malloc(end - begin + 1)) == NULL)
+            return "Out of memory";
+        memcpy(reader->names[i], begin, end - begin);
+        reader->names[i][end - begin] = '\0';
+    }
+
+    return NULL;
+}
+
+/*
+ * Read the header, the input being read in chunks from then on: nothing else
+ * should read from `in`. On errors, `error` is set to a message if not NULL.
+ */
+struct column_reader *make_column_reader(FILE *in, enum column_format format,
+                                         const char **error)
+{
+    struct column_reader *ret = calloc(1, sizeof(*ret));
+    const char *message = "Out of memory";
+
+    if (ret != NULL)
+    {
+        ret->in = in;
+        ret->format = format;
+        if (!fill(ret) && ret->error)
+            message = "Could not read the input";
+        else
+            message = read_header(ret);
+    }
+
+    if (message == NULL)
+        return ret;
+
+    if (error)
+        *error = message;
+    destroy_column_reader(ret);
+    return NULL;
+}
+
+size_t column_count(const struct column_reader *reader)
+{
+    return reader->nb_columns;
+}
+
+const char *const *column_names(const struct column_reader *reader)
+{
+    return (const char *const *)reader->names;
+}
+
+static bool read_field(const char **input, int *val)
+{
+    const char *it = skip_blanks(*input);
+    bool negative = *it == '-';
+
+    if (*it == '-' || *it == '+')
+        it += 1;
+    if (!scan_signed_int(&it, negative, val))
+        return false;
+
+    *input = skip_blanks(it);
+    return true;
+}
+
+static bool read_row(const char *line, int *const *columns, size_t row,
+                     size_t nb_columns)
+{
+    for (size_t i = 0; i < nb_columns; ++i)
+    {
+        if (i > 0 && *line++ != ',')
+            return false;
+        if (!read_field(&line, &columns[i][row]))
+            return false;
+    }
+
+    return *line == '\0';
+}
+
+static size_t read_csv(struct column_reader *reader, int *const *columns,
+                       size_t max_rows)
+{
+    size_t nb_rows = 0;
+
+    while (nb_rows < max_rows)
+    {
+        const char *line = next_line(reader);
+
+        if (line == NULL)
+            break;
+        if (*skip_blanks(line) == '\0')
+            continue; // Empty lines are ignored
+
+        // Rows before the invalid one are still returned
+        if (!read_row(line, columns, nb_rows, reader->nb_columns))
+        {
+            reader->error = true;
+            break;
+        }
+        nb_rows += 1;
+    }
+
+    return nb_rows;
+}
+
+/*
+ * Read exactly `len` bytes, returns false at the end of input.
+ */
+static bool read_bytes(struct column_reader *reader, void *data, size_t len)
+{
+    while (reader->end - reader->begin < len)
+        if (!fill(reader))
+            return false;
+
+    memcpy(data, reader->buf + reader->begin, len);
+    reader->begin += len;
+    return true;
+}
+
+static bool read_block(struct column_reader *reader)
+{
+    uint32_t nb_rows = 0;
+
+    reader->block_rows = 0;
+    reader->block_pos = 0;
+
+    if (!read_bytes(reader, &nb_rows, sizeof(nb_rows)))
+    {
+        // Stopping in the middle of the row count is an error
+        reader->error |= reader->begin != reader->end;
+        return false;
+    }
+
+    size_t size = (size_t)nb_rows * reader->nb_columns;
+    if (nb_rows > MAX_BLOCK_ROWS)
+    {
+        reader->error = true;
+        return false;
+    }
+
+    if (size > reader->block_capacity)
+    {
+        int32_t *block = realloc(reader->block, size * sizeof(*block));
+        if (block == NULL)
+        {
+            reader->error = true;
+            return false;
+        }
+        reader->block = block;
+        reader->block_capacity = size;
+    }
+
+    if (!read_bytes(reader, reader->block, size * sizeof(*reader->block)))
+    {
+        reader->error = true;
+        return false;
+    }
+
+    reader->block_rows = nb_rows;
+    return true;
+}
+
+static size_t read_binary(struct column_reader *reader, int *const *columns,
+                          size_t max_rows)
+{
+    while (reader->block_pos == reader->block_rows)
+        if (!read_block(reader))
+            return 0;
+
+    size_t nb_rows = reader->block_rows - reader->block_pos;
+    if (nb_rows > max_rows)
+        nb_rows = max_rows;
+
+    for (size_t i = 0; i < reader->nb_columns; ++i)
+    {
+        const int32_t *column = reader->block + i * reader->block_rows;
+
+        for (size_t j = 0; j < nb_rows; ++j)
+            columns[i][j] = column[reader->block_pos + j];
+    }
+
+    reader->block_pos += nb_rows;
+    return nb_rows;
+}
+
+/*
+ * Rows are read in blocks, at most `max_rows` at once: `columns[i]` receives
+ * the values of the column of index `i`.
+ */
+size_t read_columns(struct column_reader *reader, int *const *columns,
+                    size_t max_rows)
+{
+    if (reader->error)
+        return 0;
+
+    if (reader->format == COLUMNS_BINARY)
+        return read_binary(reader, columns, max_rows);
+    return read_csv(reader, columns, max_rows);
+}
+
+bool destroy_column_reader(struct column_reader *reader)
+{
+    if (reader == NULL)
+        return true;
+
+    bool ret = !reader->error;
+
+    for (size_t i = 0; reader->names && i < reader->nb_columns; ++i)
+        free(reader->names[i]);
+    free(reader->names);
+    free(reader->block);
+    free(reader->buf);
+    free(reader);
+
+    return ret;
+}
+
+bool write_column_header(FILE *out, enum column_format format,
+                         const char *name)
+{
+    (void)format; // Both formats use the same header
+
+    return fprintf(out, "%s\n", name) >= 0;
+}
+
+/*
+ * Digits are written backwards, from the end of the buffer.
+ */
+static char *format_int(char *end, int val)
+{
+    unsigned num = val < 0 ? -(unsigned)val : (unsigned)val;
+
+    do
+    {
+        *--end = '0' + num % 10;
+        num /= 10;
+    } while (num > 0);
+
+    if (val < 0)
+        *--end = '-';
+
+    return end;
+}
+
+bool write_column(FILE *out, enum column_format format, const int *vals,
+                  size_t nb_rows)
+{
+    if (format == COLUMNS_BINARY)
+    {
+        uint32_t count = nb_rows;
+        int32_t block[1024];
+
+        if (fwrite(&count, sizeof(count), 1, out) != 1)
+            return false;
+        for (size_t i = 0; i < nb_rows; i += 1024)
+        {
+            size_t len = nb_rows - i < 1024 ? nb_rows - i : 1024;
+
+            for (size_t j = 0; j < len; ++j)
+                block[j] = vals[i + j];
+            if (fwrite(block, sizeof(*block), len, out) != len)
+                return false;
+        }
+        return true;
+    }
+
+    char buf[CHUNK_SIZE];
+    size_t len = 0;
+    for (size_t i = 0; i < nb_rows; ++i)
+    {
+        char num[16];
+        char *end = num + sizeof(num);
+        char *begin = format_int(end - 1, vals[i]);
+
+        end[-1] = '\n';
+        if (len + (end - begin) > sizeof(buf))
+        {
+            if (fwrite(buf, 1, len, out) != len)
+                return false;
+            len = 0;
+        }
+        memcpy(buf + len, begin, end - begin);
+        len += end - begin;
+    }
+
+    return fwrite(buf, 1, len, out) == len;
+}
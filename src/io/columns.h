@@ -0,0 +1,49 @@
+#ifndef COLUMNS_H
+#define COLUMNS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Both formats start with a line of comma-separated column names.
+ *
+ * In CSV files, each following line is a row of integers. Binary files are
+ * made of blocks: a row count, then the values of each column in turn, all of
+ * them 32-bit integers in native byte order.
+ */
+enum column_format
+{
+    COLUMNS_CSV,
+    COLUMNS_BINARY,
+};
+
+// Forward declaration
+struct column_reader;
+
+/*
+ * Returns NULL if the header could not be read, or names a column twice,
+ * setting `error` to a message unless it is NULL.
+ */
+struct column_reader *make_column_reader(FILE *in, enum column_format format,
+                                         const char **error);
+
+size_t column_count(const struct column_reader *reader);
+const char *const *column_names(const struct column_reader *reader);
+
+// Returns the number of rows read in each column, 0 at the end of input
+size_t read_columns(struct column_reader *reader, int *const *columns,
+                    size_t max_rows);
+
+// Returns false if the input was invalid, or could not be read
+bool destroy_column_reader(struct column_reader *reader);
+
+// Write the header of a file with a single column
+bool write_column_header(FILE *out, enum column_format format,
+                         const char *name);
+
+// Write a block of rows of a single column
+bool write_column(FILE *out, enum column_format format, const int *vals,
+                  size_t nb_rows);
+
+#endif /* !COLUMNS_H */
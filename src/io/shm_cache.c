@@ -0,0 +1,505 @@
+#include "shm_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "parse/scan.h"
+
+#define LOAD(Ptr) __atomic_load_n((Ptr), __ATOMIC_ACQUIRE)
+#define STORE(Ptr, Val) __atomic_store_n((Ptr), (Val), __ATOMIC_RELEASE)
+#define PEEK(Ptr) __atomic_load_n((Ptr), __ATOMIC_RELAXED)
+#define POKE(Ptr, Val) __atomic_store_n((Ptr), (Val), __ATOMIC_RELAXED)
+#define COUNT(Ptr) __atomic_fetch_add((Ptr), 1, __ATOMIC_RELAXED)
+
+#define MAGIC 0x6576616c63616368 // "evalcach"
+
+// Slots where a key can be stored, starting from the one its hash points to
+#define NB_PROBES 8
+
+// Time given to the process creating the segment to initialize it
+#define OPEN_TIMEOUT_MS 1000
+
+// PIDs fit in 22 bits, see `PID_MAX_LIMIT`
+#define PID_BITS 22
+#define PID_MASK ((1u << PID_BITS) - 1)
+
+// PID namespaces told apart by the writers, with tags 1 and up
+#define NB_NAMESPACES 32
+
+/*
+ * Expressions are hashed twice, with FNV-1a and a multiply-rotate hash, so that
+ * keys of 128 bits can be compared instead of whole expressions.
+ */
+#define FNV_OFFSET 0xcbf29ce484222325
+#define FNV_PRIME 0x100000001b3
+#define MIX_OFFSET 0x9e3779b97f4a7c15
+#define MIX_PRIME 0xff51afd7ed558ccd
+
+void init_expr_key(struct expr_key *key, unsigned seed)
+{
+    key->hash[0] = FNV_OFFSET ^ seed;
+    key->hash[1] = MIX_OFFSET + seed;
+    key->blank = false;
+    key->digit = false;
+}
+
+static void hash_char(struct expr_key *key, unsigned char c)
+{
+    key->hash[0] = (key->hash[0] ^ c) * FNV_PRIME;
+    key->hash[1] = (key->hash[1] + c) * MIX_PRIME;
+    key->hash[1] = key->hash[1] << 31 | key->hash[1] >> 33;
+}
+
+/*
+ * Whitespace and digits are classified by the same helpers as the parsers.
+ */
+void hash_expr(struct expr_key *key, const char *input, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        char c = input[i];
+        bool digit = is_digit(c);
+
+        if (is_space(c))
+        {
+            key->blank = true;
+            continue;
+        }
+
+        // "1 2" is not the same as "12"
+        if (key->blank && key->digit && digit)
+            hash_char(key, ' ');
+        hash_char(key, c);
+        key->blank = false;
+        key->digit = digit;
+    }
+}
+
+/*
+ * Each slot is a sequence lock: its version is odd while it is being written,
+ * by the process whose owner ID is in the low half of `state`. Readers retry
+ * nothing, a slot being written is a miss.
+ */
+struct slot
+{
+    uint64_t state; // 0 if it was never written
+    uint64_t key[2]; // Never matches any key once it is { 0, 0 }
+    uint32_t tick; // Clock of the last use, to evict the least recently used
+    int32_t value;
+};
+
+struct header
+{
+    uint64_t magic; // Written last, once the segment is initialized
+    uint64_t nb_slots;
+    uint32_t clock;
+    struct cache_stats stats;
+    uint64_t namespaces[NB_NAMESPACES]; // Inodes, in the order of their tags
+};
+
+struct shm_cache
+{
+    struct header *header;
+    struct slot *slots;
+    size_t size;
+    uint32_t tag; // Of the PID namespace of the process, 0 if unknown
+    struct cache_stats stats;
+};
+
+#define VERSION(State) ((uint32_t)((State) >> 32))
+#define MAKE_STATE(Version, Owner) ((uint64_t)(Version) << 32 | (Owner))
+
+// The tag of the namespace of the process, then its PID
+#define TAG(Owner) ((Owner) >> PID_BITS)
+#define MAKE_OWNER(Tag, Pid) ((uint32_t)(Tag) << PID_BITS | (Pid))
+
+static size_t segment_size(size_t nb_slots)
+{
+    size_t header = (sizeof(struct header) + 63) / 64 * 64;
+
+    return header + nb_slots * sizeof(struct slot);
+}
+
+static void sleep_ms(long ms)
+{
+    struct timespec ts = { 0, ms * 1000000 };
+    nanosleep(&ts, NULL);
+}
+
+/*
+ * Map the segment, once the process which created it has set its size.
+ * Returns false if it failed to, or left the header half-initialized.
+ */
+static bool map_segment(struct shm_cache *cache, int fd, bool created,
+                        size_t nb_slots)
+{
+    struct stat st;
+
+    if (created)
+    {
+        cache->size = segment_size(nb_slots);
+        if (ftruncate(fd, cache->size) < 0)
+            return false;
+    }
+    else
+    {
+        for (int i = 0; fstat(fd, &st) == 0 && st.st_size == 0; ++i)
+        {
+            if (i == OPEN_TIMEOUT_MS)
+                return false;
+            sleep_ms(1);
+        }
+        cache->size = st.st_size;
+        if (cache->size < segment_size(NB_PROBES))
+            return false;
+    }
+
+    void *mem =
+        mmap(NULL, cache->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED)
+        return false;
+
+    cache->header = mem;
+    cache->slots = (void *)((char *)mem + segment_size(0));
+
+    if (created)
+    {
+        // The segment is zero-filled: every slot is empty
+        cache->header->nb_slots = nb_slots;
+        STORE(&cache->header->magic, MAGIC);
+        return true;
+    }
+
+    for (int i = 0; LOAD(&cache->header->magic) != MAGIC; ++i)
+    {
+        if (i == OPEN_TIMEOUT_MS)
+            break;
+        sleep_ms(1);
+    }
+
+    if (LOAD(&cache->header->magic) == MAGIC
+        && segment_size(cache->header->nb_slots) == cache->size)
+        return true;
+
+    munmap(mem, cache->size);
+    cache->header = NULL;
+    return false;
+}
+
+static int open_segment(const char *name, bool *created)
+{
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+    *created = fd >= 0;
+    if (fd < 0 && errno == EEXIST)
+        fd = shm_open(name, O_RDWR, 0600);
+
+    return fd;
+}
+
+/*
+ * Remove the segment `fd` was opened from, unless another process already
+ * replaced it.
+ */
+static void unlink_segment(const char *name, int fd)
+{
+    struct stat st;
+    struct stat current;
+    int current_fd = shm_open(name, O_RDONLY, 0);
+
+    if (current_fd < 0)
+        return;
+
+    bool same = fstat(fd, &st) == 0 && fstat(current_fd, &current) == 0
+        && st.st_dev == current.st_dev && st.st_ino == current.st_ino;
+
+    close(current_fd);
+    if (same)
+        shm_unlink(name);
+}
+
+/*
+ * PIDs only mean something in the PID namespace they come from, so the
+ * namespace of each process gets a tag, stored along its PID while it
+ * writes a slot. Returns 0 if the namespace is unknown, or if there are no
+ * tags left.
+ */
+static uint32_t namespace_tag(struct header *header)
+{
+    struct stat st;
+
+    if (stat("/proc/self/ns/pid", &st) < 0 || st.st_ino == 0)
+        return 0;
+
+    for (uint32_t i = 0; i < NB_NAMESPACES; ++i)
+    {
+        uint64_t inode = 0;
+
+        // Sets `inode` to the one of the tag if it is taken
+        if (__atomic_compare_exchange_n(&header->namespaces[i], &inode,
+                                        st.st_ino, false, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)
+            || inode == st.st_ino)
+            return i + 1;
+    }
+
+    return 0;
+}
+
+/*
+ * The number of slots is rounded up to a power of 2. It is only used if the
+ * segment is created, the one of the existing segment is used otherwise.
+ */
+struct shm_cache *make_shm_cache(const char *name, size_t nb_slots)
+{
+    struct shm_cache *ret = calloc(1, sizeof(*ret));
+    size_t slots = NB_PROBES;
+    bool mapped = false;
+
+    if (ret == NULL)
+        return NULL;
+
+    while (slots < nb_slots)
+        slots *= 2;
+
+    // A segment left half-initialized by a process which died is replaced
+    for (int i = 0; i < 2 && !mapped; ++i)
+    {
+        bool created;
+        int fd = open_segment(name, &created);
+
+        if (fd < 0)
+            break;
+
+        mapped = map_segment(ret, fd, created, slots);
+        if (!mapped)
+            unlink_segment(name, fd);
+        close(fd);
+
+        if (created)
+            break;
+    }
+
+    if (!mapped)
+    {
+        destroy_shm_cache(ret);
+        return NULL;
+    }
+
+    ret->tag = namespace_tag(ret->header);
+    return ret;
+}
+
+static struct slot *probe(struct shm_cache *cache, const struct expr_key *key,
+                          size_t i)
+{
+    size_t mask = cache->header->nb_slots - 1;
+
+    return &cache->slots[(key->hash[0] + i) & mask];
+}
+
+// Never 0, see `reclaim`
+static uint64_t key_check(const struct expr_key *key)
+{
+    return key->hash[1] | 1;
+}
+
+/*
+ * Returns false if the slot was being written, or does not hold the key.
+ */
+static bool read_slot(struct slot *slot, uint64_t state,
+                      const struct expr_key *key, int *res)
+{
+    if (VERSION(state) % 2 != 0)
+        return false;
+
+    uint64_t key0 = PEEK(&slot->key[0]);
+    uint64_t key1 = PEEK(&slot->key[1]);
+    int value = PEEK(&slot->value);
+
+    // The slot was not written meanwhile
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (PEEK(&slot->state) != state)
+        return false;
+
+    if (key0 != key->hash[0] || key1 != key_check(key))
+        return false;
+
+    *res = value;
+    return true;
+}
+
+bool shm_cache_lookup(struct shm_cache *cache, const struct expr_key *key,
+                      int *res)
+{
+    for (size_t i = 0; i < NB_PROBES; ++i)
+    {
+        struct slot *slot = probe(cache, key, i);
+        uint64_t state = LOAD(&slot->state);
+
+        // Slots are never emptied: the key was not inserted further
+        if (state == 0)
+            break;
+
+        if (read_slot(slot, state, key, res))
+        {
+            POKE(&slot->tick, PEEK(&cache->header->clock));
+            COUNT(&cache->header->stats.hits);
+            cache->stats.hits += 1;
+            return true;
+        }
+    }
+
+    COUNT(&cache->header->stats.misses);
+    cache->stats.misses += 1;
+    return false;
+}
+
+// Identifies the writers of the slots, with the tag of their namespace
+static uint32_t owner_id(const struct shm_cache *cache)
+{
+    uint32_t pid = getpid(); // Not cached, in case the process forked
+
+    // The namespace is unknown if the PID does not fit
+    return pid > PID_MASK ? pid & PID_MASK : MAKE_OWNER(cache->tag, pid);
+}
+
+/*
+ * A slot left odd by a dead process is invalidated, so that it can be used
+ * again. A PID reused since then keeps it busy until that process exits.
+ * Only processes of the same PID namespace can tell, the slots of the others
+ * stay busy.
+ */
+static void reclaim(struct shm_cache *cache, struct slot *slot,
+                    uint64_t state, uint32_t self)
+{
+    uint32_t owner = (uint32_t)state;
+
+    if (TAG(owner) == 0 || TAG(owner) != TAG(self) || owner == self)
+        return;
+    if (kill(owner & PID_MASK, 0) == 0 || errno != ESRCH)
+        return;
+
+    uint64_t locked = MAKE_STATE(VERSION(state) + 2, self);
+    if (!__atomic_compare_exchange_n(&slot->state, &state, locked, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
+
+    POKE(&slot->key[0], 0);
+    POKE(&slot->key[1], 0);
+    POKE(&slot->tick, 0);
+    STORE(&slot->state, MAKE_STATE(VERSION(locked) + 1, self));
+
+    COUNT(&cache->header->stats.reclaims);
+    cache->stats.reclaims += 1;
+}
+
+/*
+ * Pick the first empty slot, or else the least recently used one. Returns
+ * NULL if the key is already there, or if every slot is being written.
+ */
+static struct slot *find_victim(struct shm_cache *cache,
+                                const struct expr_key *key, uint32_t clock,
+                                uint32_t self, uint64_t *victim_state)
+{
+    struct slot *victim = NULL;
+    uint32_t oldest = 0;
+
+    for (size_t i = 0; i < NB_PROBES; ++i)
+    {
+        struct slot *slot = probe(cache, key, i);
+        uint64_t state = LOAD(&slot->state);
+        int value;
+
+        if (state == 0)
+        {
+            *victim_state = state;
+            return slot;
+        }
+
+        if (VERSION(state) % 2 != 0)
+        {
+            reclaim(cache, slot, state, self);
+            continue;
+        }
+
+        if (read_slot(slot, state, key, &value))
+            return NULL;
+
+        uint32_t age = clock - PEEK(&slot->tick);
+        if (victim == NULL || age > oldest)
+        {
+            victim = slot;
+            oldest = age;
+            *victim_state = state;
+        }
+    }
+
+    return victim;
+}
+
+/*
+ * Another process racing for the same slot wins, the entry is then dropped.
+ */
+void shm_cache_insert(struct shm_cache *cache, const struct expr_key *key,
+                      int res)
+{
+    uint32_t clock = __atomic_add_fetch(&cache->header->clock, 1,
+                                        __ATOMIC_RELAXED);
+    uint32_t self = owner_id(cache);
+    uint64_t state = 0;
+    struct slot *slot = find_victim(cache, key, clock, self, &state);
+
+    if (slot == NULL)
+        return;
+
+    uint64_t locked = MAKE_STATE(VERSION(state) + 1, self);
+    if (!__atomic_compare_exchange_n(&slot->state, &state, locked, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
+
+    // The slot is odd before any of its fields are written
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    POKE(&slot->key[0], key->hash[0]);
+    POKE(&slot->key[1], key_check(key));
+    POKE(&slot->value, res);
+    POKE(&slot->tick, clock);
+    STORE(&slot->state, MAKE_STATE(VERSION(locked) + 1, self));
+
+    if (state != 0)
+    {
+        COUNT(&cache->header->stats.evictions);
+        cache->stats.evictions += 1;
+    }
+    COUNT(&cache->header->stats.inserts);
+    cache->stats.inserts += 1;
+}
+
+void shm_cache_stats(const struct shm_cache *cache, struct cache_stats *local,
+                     struct cache_stats *shared)
+{
+    const struct cache_stats *stats = &cache->header->stats;
+
+    *local = cache->stats;
+    shared->hits = PEEK(&stats->hits);
+    shared->misses = PEEK(&stats->misses);
+    shared->inserts = PEEK(&stats->inserts);
+    shared->evictions = PEEK(&stats->evictions);
+    shared->reclaims = PEEK(&stats->reclaims);
+}
+
+void destroy_shm_cache(struct shm_cache *cache)
+{
+    if (cache == NULL)
+        return;
+
+    if (cache->header)
+        munmap(cache->header, cache->size);
+    free(cache);
+}
@@ -0,0 +1,50 @@
+#ifndef SHM_CACHE_H
+#define SHM_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Key of an expression, built incrementally: whitespace is ignored, except
+ * between two numbers, so that spacing does not matter.
+ */
+struct expr_key
+{
+    uint64_t hash[2];
+    bool blank; // Whitespace was skipped since the last character
+    bool digit; // The last character was a digit
+};
+
+// Expressions hashed with different `seed`s never share results
+void init_expr_key(struct expr_key *key, unsigned seed);
+void hash_expr(struct expr_key *key, const char *input, size_t len);
+
+// Forward declaration
+struct shm_cache;
+
+// Counters of a single process, or shared by all processes using the cache
+struct cache_stats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t inserts;
+    uint64_t evictions;
+    uint64_t reclaims; // Entries left half-written by dead processes
+};
+
+// Opens the segment `name`, creating it with `nb_slots` entries if needed
+struct shm_cache *make_shm_cache(const char *name, size_t nb_slots);
+
+bool shm_cache_lookup(struct shm_cache *cache, const struct expr_key *key,
+                      int *res);
+void shm_cache_insert(struct shm_cache *cache, const struct expr_key *key,
+                      int res);
+
+void shm_cache_stats(const struct shm_cache *cache, struct cache_stats *local,
+                     struct cache_stats *shared);
+
+// The segment is kept for the other processes, see `shm_unlink`
+void destroy_shm_cache(struct shm_cache *cache);
+
+#endif /* !SHM_CACHE_H */
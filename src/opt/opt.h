@@ -0,0 +1,26 @@
+#ifndef OPT_H
+#define OPT_H
+
+#include "ast/ast.h"
+
+struct ast_node *specialize_ast(struct ast_node *ast);
+
+// Bounds of the values of a subtree, or of a variable
+struct value_range
+{
+    int min;
+    int max;
+};
+
+// Operators which could overflow or divide by zero, and those proven not to
+struct range_stats
+{
+    size_t nb_checks;
+    size_t nb_elided;
+};
+
+struct value_range analyze_ranges(struct ast_node *ast,
+                                  const struct value_range *vars,
+                                  struct range_stats *stats);
+
+#endif /* !OPT_H */
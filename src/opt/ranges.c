@@ -0,0 +1,321 @@
+#include "opt.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ast/ast.h"
+#include "eval/eval.h"
+
+#define UNREACHABLE() __builtin_unreachable()
+
+/*
+ * Bounds are computed on 64 bits, where sums, differences and products of two
+ * `int` cannot overflow. Powers saturate instead.
+ */
+struct bounds
+{
+    int64_t min;
+    int64_t max;
+};
+
+static int64_t min_of(int64_t lhs, int64_t rhs)
+{
+    return lhs < rhs ? lhs : rhs;
+}
+
+static int64_t max_of(int64_t lhs, int64_t rhs)
+{
+    return lhs > rhs ? lhs : rhs;
+}
+
+static bool fits(struct bounds val)
+{
+    return val.min >= INT_MIN && val.max <= INT_MAX;
+}
+
+static bool contains(struct bounds val, int64_t num)
+{
+    return val.min <= num && num <= val.max;
+}
+
+static int64_t clamp(int64_t num)
+{
+    return min_of(max_of(num, INT_MIN), INT_MAX);
+}
+
+/*
+ * Factorials of numbers up to MAX_FACT + 1 fit on 64 bits, which is enough to
+ * know that they overflow.
+ */
+static int64_t fact_of(int64_t num)
+{
+    int64_t ret = 1;
+
+    for (int64_t i = 2; i <= min_of(num, MAX_FACT + 1); ++i)
+        ret *= i;
+
+    return ret;
+}
+
+/*
+ * Saturates above INT_MAX.
+ */
+static int64_t pow_of(int64_t base, int64_t exp)
+{
+    int64_t ret = 1;
+
+    if (base <= 1)
+        return base == 1 || exp == 0 ? 1 : 0;
+
+    while (exp-- > 0 && ret <= INT_MAX)
+        ret *= base;
+
+    return ret;
+}
+
+static struct bounds times_bounds(struct bounds lhs, struct bounds rhs)
+{
+    int64_t corners[] = { lhs.min * rhs.min, lhs.min * rhs.max,
+                          lhs.max * rhs.min, lhs.max * rhs.max };
+    struct bounds ret = { corners[0], corners[0] };
+
+    for (size_t i = 1; i < 4; ++i)
+    {
+        ret.min = min_of(ret.min, corners[i]);
+        ret.max = max_of(ret.max, corners[i]);
+    }
+
+    return ret;
+}
+
+/*
+ * The quotient is monotonic in the dividend, and in the divisor on each side
+ * of 0: its extremes are reached on the bounds, or on -1 and 1.
+ */
+static struct bounds divides_bounds(struct bounds lhs, struct bounds rhs)
+{
+    int64_t divisors[] = { rhs.min, rhs.max, -1, 1 };
+    struct bounds ret = { INT64_MAX, INT64_MIN };
+
+    for (size_t i = 0; i < 4; ++i)
+    {
+        if (divisors[i] == 0 || !contains(rhs, divisors[i]))
+            continue;
+
+        int64_t min = lhs.min / divisors[i];
+        int64_t max = lhs.max / divisors[i];
+
+        ret.min = min_of(ret.min, min_of(min, max));
+        ret.max = max_of(ret.max, max_of(min, max));
+    }
+
+    return ret;
+}
+
+/*
+ * Negative exponents behave like their absolute value.
+ */
+static struct bounds pow_bounds(struct bounds lhs, struct bounds rhs)
+{
+    int64_t base = max_of(-lhs.min, lhs.max);
+    int64_t exp = max_of(-rhs.min, rhs.max);
+    int64_t max = max_of(pow_of(base, exp), 1);
+    struct bounds ret = { lhs.min >= 0 ? 0 : -max, max };
+
+    return ret;
+}
+
+static struct bounds unop_bounds(enum op_kind op, struct bounds val)
+{
+    struct bounds ret = val;
+
+    switch (op)
+    {
+    case UNOP_IDENTITY:
+        break;
+    case UNOP_NEGATE:
+        ret.min = -val.max;
+        ret.max = -val.min;
+        break;
+    case UNOP_FACT:
+        ret.min = fact_of(val.min);
+        ret.max = fact_of(val.max);
+        break;
+    default:
+        UNREACHABLE();
+    }
+
+    return ret;
+}
+
+static struct bounds binop_bounds(enum op_kind op, struct bounds lhs,
+                                  struct bounds rhs)
+{
+    struct bounds ret;
+
+    switch (op)
+    {
+    case BINOP_PLUS:
+        ret.min = lhs.min + rhs.min;
+        ret.max = lhs.max + rhs.max;
+        return ret;
+    case BINOP_MINUS:
+        ret.min = lhs.min - rhs.max;
+        ret.max = lhs.max - rhs.min;
+        return ret;
+    case BINOP_TIMES:
+        return times_bounds(lhs, rhs);
+    case BINOP_DIVIDES:
+        return divides_bounds(lhs, rhs);
+    case BINOP_POW:
+        return pow_bounds(lhs, rhs);
+    default:
+        UNREACHABLE();
+    }
+}
+
+// Bounds of the variables bound so far, innermost first
+struct scope
+{
+    size_t var;
+    struct bounds bounds;
+    const struct scope *next;
+};
+
+/*
+ * The operator is safe if its result always fits in an `int`. Otherwise it is
+ * checked, and its result fits once the check passed.
+ */
+static struct bounds mark(struct ast_node *ast, struct bounds res, bool safe,
+                          struct range_stats *stats)
+{
+    ast->safe = safe && fits(res);
+
+    if (stats)
+    {
+        stats->nb_checks += 1;
+        stats->nb_elided += ast->safe;
+    }
+
+    res.min = clamp(res.min);
+    res.max = clamp(res.max);
+    return res;
+}
+
+static struct bounds analyze(struct ast_node *ast,
+                             const struct value_range *vars,
+                             const struct scope *scope,
+                             struct range_stats *stats);
+
+/*
+ * Binary operators along the left spine are analyzed in a loop from the bottom
+ * up, so that long left-associative chains do not recurse as deep as they are
+ * long.
+ */
+static struct bounds analyze_spine(struct ast_node *ast,
+                                   const struct value_range *vars,
+                                   const struct scope *scope,
+                                   struct range_stats *stats)
+{
+    struct bounds ret = { INT_MIN, INT_MAX };
+    struct ast_spine spine;
+    init_spine(&spine);
+
+    // Out of memory, none of the operators are marked safe: all get checked
+    struct ast_node *node = walk_spine(&spine, ast);
+    if (node)
+        ret = analyze(node, vars, scope, stats);
+
+    while (node && (node = pop_spine(&spine)))
+    {
+        enum op_kind op = node->val.bin_op.op;
+        struct bounds rhs = analyze(node->val.bin_op.rhs, vars, scope, stats);
+
+        ret = mark(node, binop_bounds(op, ret, rhs),
+                   op != BINOP_DIVIDES || !contains(rhs, 0), stats);
+    }
+
+    destroy_spine(&spine);
+    return ret;
+}
+
+static struct bounds analyze(struct ast_node *ast,
+                             const struct value_range *vars,
+                             const struct scope *scope,
+                             struct range_stats *stats)
+{
+    struct bounds ret = { INT_MIN, INT_MAX };
+    struct bounds lhs;
+    struct bounds rhs;
+
+    switch (ast->kind)
+    {
+    case NODE_NUM:
+        ast->safe = true;
+        ret.min = ret.max = ast->val.num;
+        return ret;
+    case NODE_VAR:
+        ast->safe = true;
+        for (; scope; scope = scope->next)
+            if (scope->var == ast->val.var)
+                return scope->bounds;
+        if (vars)
+        {
+            ret.min = vars[ast->val.var].min;
+            ret.max = vars[ast->val.var].max;
+        }
+        return ret;
+    case NODE_LET:
+    {
+        const struct scope inner = {
+            ast->val.let.var,
+            analyze(ast->val.let.value, vars, scope, stats),
+            scope,
+        };
+
+        ast->safe = true;
+        return analyze(ast->val.let.body, vars, &inner, stats);
+    }
+    case NODE_UNOP:
+        lhs = analyze(ast->val.un_op.tree, vars, scope, stats);
+        ret = unop_bounds(ast->val.un_op.op, lhs);
+        if (ast->val.un_op.op == UNOP_IDENTITY)
+            break;
+        return mark(ast, ret, true, stats);
+    case NODE_BINOP:
+        return analyze_spine(ast, vars, scope, stats);
+    case NODE_CONSTOP:
+        lhs = analyze(ast->val.const_op.tree, vars, scope, stats);
+        rhs.min = rhs.max = ast->val.const_op.val;
+        if (ast->val.const_op.op == UNOP_FACT)
+            return mark(ast, unop_bounds(UNOP_FACT, lhs), true, stats);
+        ret = binop_bounds(ast->val.const_op.op, lhs, rhs);
+        if (ast->val.const_op.op == BINOP_POW)
+            return mark(ast, ret, true, stats);
+        break; // Divisions by constants never overflow, see `specialize_ast`
+    }
+
+    ast->safe = true;
+    return ret;
+}
+
+/*
+ * Propagate the bounds of the values of each subtree, from the literals and the
+ * variables up to the root, and mark the operators which can neither overflow
+ * nor divide by zero as safe: safe arithmetic only checks the others.
+ *
+ * `vars[i]` bounds the variable of index `i`, or any value is possible if it
+ * is NULL. Variables bound in the tree get the bounds of their value. The
+ * operators which could fail and the checks elided are added to `stats`,
+ * unless it is NULL. Returns the bounds of the whole tree.
+ */
+struct value_range analyze_ranges(struct ast_node *ast,
+                                  const struct value_range *vars,
+                                  struct range_stats *stats)
+{
+    struct bounds res = analyze(ast, vars, NULL, stats);
+    struct value_range ret = { res.min, res.max };
+
+    return ret;
+}
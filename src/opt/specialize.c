@@ -0,0 +1,261 @@
+#include "opt.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ast/ast.h"
+#include "eval/eval.h"
+
+/*
+ * Is the tree a literal, possibly preceded by prefix operators
+ */
+static bool const_value(const struct ast_node *ast, int *val)
+{
+    switch (ast->kind)
+    {
+    case NODE_NUM:
+        *val = ast->val.num;
+        return true;
+    case NODE_UNOP:
+        if (ast->val.un_op.op == UNOP_FACT)
+            return false;
+        if (!const_value(ast->val.un_op.tree, val))
+            return false;
+        if (ast->val.un_op.op == UNOP_NEGATE)
+            *val = -(unsigned)*val; // Negating INT_MIN wraps around
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Replace the binary operator by its left operand.
+ */
+static struct ast_node *keep_lhs(struct ast_node *ast)
+{
+    struct ast_node *lhs = ast->val.bin_op.lhs;
+
+    ast->val.bin_op.lhs = NULL;
+    destroy_ast(ast);
+
+    return lhs;
+}
+
+/*
+ * Replace the binary operator by a specialized operator on its left operand.
+ */
+static struct ast_node *make_specialized(struct ast_node *ast, int val)
+{
+    struct ast_node *ret =
+        make_constop(ast->val.bin_op.op, ast->val.bin_op.lhs, val);
+
+    if (ret == NULL)
+        return ast; // Not specializing it is not an error
+
+    ast->val.bin_op.lhs = NULL;
+    destroy_ast(ast);
+
+    return ret;
+}
+
+/*
+ * Compute the magic number and shift amount used to divide by `d`, which must
+ * not be -1, 0, nor 1. See Hacker's Delight, figure 10-1.
+ */
+static void div_magic(struct constop_node *const_op)
+{
+    const unsigned two31 = 0x80000000u;
+    int d = const_op->val;
+    unsigned ad = d < 0 ? -(unsigned)d : (unsigned)d;
+    unsigned t = two31 + ((unsigned)d >> 31);
+    unsigned anc = t - 1 - t % ad; // Absolute value of nc
+    int p = 31;
+    unsigned q1 = two31 / anc; // 2^p / |nc|
+    unsigned r1 = two31 - q1 * anc; // rem(2^p, |nc|)
+    unsigned q2 = two31 / ad; // 2^p / |d|
+    unsigned r2 = two31 - q2 * ad; // rem(2^p, |d|)
+    unsigned delta;
+
+    do
+    {
+        p += 1;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc)
+        {
+            q1 += 1;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad)
+        {
+            q2 += 1;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    unsigned magic = q2 + 1;
+    const_op->magic = d < 0 ? -magic : magic;
+    const_op->shift = p - 32;
+}
+
+static struct ast_node *specialize_divides(struct ast_node *ast, int val)
+{
+    // Keep division traps, and the result of `INT_MIN / -1`
+    if (val == 0 || val == -1)
+        return ast;
+    if (val == 1)
+        return keep_lhs(ast);
+
+    ast = make_specialized(ast, val);
+    if (ast->kind == NODE_CONSTOP)
+        div_magic(&ast->val.const_op);
+
+    return ast;
+}
+
+static struct ast_node *specialize_pow(struct ast_node *ast, int val)
+{
+    if (val == 1)
+        return keep_lhs(ast);
+
+    ast = make_specialized(ast, val);
+    if (ast->kind != NODE_CONSTOP)
+        return ast;
+
+    // Negative exponents behave like their absolute value
+    unsigned exp = val < 0 ? -(unsigned)val : (unsigned)val;
+    // Index of the most significant bit, -1 when the exponent is 0
+    int shift = -1;
+    while (shift < 31 && exp >> (shift + 1))
+        shift += 1;
+
+    ast->val.const_op.magic = exp;
+    ast->val.const_op.shift = shift;
+
+    return ast;
+}
+
+// Its left operand was specialized already, see `specialize_ast`
+static struct ast_node *specialize_binop(struct ast_node *ast)
+{
+    struct binop_node *bin_op = &ast->val.bin_op;
+    int val;
+
+    bin_op->rhs = specialize_ast(bin_op->rhs);
+    ast->size = 1 + ast_size(bin_op->lhs) + ast_size(bin_op->rhs);
+
+    if (!const_value(bin_op->rhs, &val))
+        return ast;
+
+    switch (bin_op->op)
+    {
+    case BINOP_DIVIDES:
+        return specialize_divides(ast, val);
+    case BINOP_POW:
+        return specialize_pow(ast, val);
+    default:
+        return ast;
+    }
+}
+
+static struct ast_node *specialize_unop(struct ast_node *ast)
+{
+    struct unop_node *un_op = &ast->val.un_op;
+
+    un_op->tree = specialize_ast(un_op->tree);
+    ast->size = 1 + ast_size(un_op->tree);
+
+    if (un_op->op != UNOP_FACT)
+        return ast;
+
+    struct ast_node *tree = make_constop(UNOP_FACT, un_op->tree, 0);
+    if (tree == NULL)
+        return ast; // Not specializing it is not an error
+
+    un_op->tree = NULL;
+    destroy_ast(ast);
+
+    // Factorials of constants are looked up once and for all, unless they
+    // overflow: safe arithmetic has to report it
+    int val;
+    if (const_value(tree->val.const_op.tree, &val) && val <= MAX_FACT)
+    {
+        struct ast_node *num = make_num(eval_ast(tree));
+        if (num != NULL)
+        {
+            destroy_ast(tree);
+            return num;
+        }
+    }
+
+    return tree;
+}
+
+// Operand at the bottom of a left spine, see `specialize_ast`
+static struct ast_node *specialize_operand(struct ast_node *ast)
+{
+    switch (ast->kind)
+    {
+    case NODE_BINOP:
+        break; // Walked in a loop by `specialize_ast`
+    case NODE_UNOP:
+        return specialize_unop(ast);
+    case NODE_LET:
+        ast->val.let.value = specialize_ast(ast->val.let.value);
+        ast->val.let.body = specialize_ast(ast->val.let.body);
+        ast->size =
+            1 + ast_size(ast->val.let.value) + ast_size(ast->val.let.body);
+        break;
+    case NODE_NUM:
+    case NODE_CONSTOP:
+    case NODE_VAR:
+        break;
+    }
+
+    return ast;
+}
+
+/*
+ * Rewrite operators with constant operands into cheaper forms, giving the
+ * same results as `eval_ast` on the original tree:
+ *
+ * - Divisions by a constant use a multiplication and a shift.
+ * - Powers with a constant exponent use a fixed chain of multiplications.
+ * - Factorials are looked up in a table, or computed right away when their
+ *   operand is constant.
+ *
+ * The tree is consumed, and the specialized tree is returned. Binary operators
+ * along the left spine are specialized in a loop from the bottom up, so that
+ * long left-associative chains do not recurse as deep as they are long.
+ */
+struct ast_node *specialize_ast(struct ast_node *ast)
+{
+    if (ast == NULL)
+        return NULL;
+
+    struct ast_spine spine;
+    init_spine(&spine);
+
+    struct ast_node *ret = walk_spine(&spine, ast);
+    if (ret == NULL)
+    {
+        destroy_spine(&spine);
+        return ast; // Not specializing it is not an error
+    }
+
+    ret = specialize_operand(ret);
+
+    struct ast_node *node;
+    while ((node = pop_spine(&spine)))
+    {
+        node->val.bin_op.lhs = ret;
+        ret = specialize_binop(node);
+    }
+
+    destroy_spine(&spine);
+    return ret;
+}
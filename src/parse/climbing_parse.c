@@ -1,33 +1,19 @@
 #include "parse.h"
 
-#include <ctype.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
 
 #include "ast/ast.h"
+#include "operators.h"
+#include "scan.h"
 
 #define UNREACHABLE() __builtin_unreachable()
 #define ARR_SIZE(Arr) (sizeof(Arr) / sizeof(*Arr))
-#define OP_STRING(...) (const char[]){__VA_ARGS__}
-#define OP_SIZE(...) (sizeof(OP_STRING(__VA_ARGS__)) - 1)
-
-static const struct {
-    const char *op;
-    const size_t op_len;
-    const enum op_kind kind;
-    const int prio;
-    const enum { ASSOC_LEFT, ASSOC_RIGHT, ASSOC_NONE } assoc;
-    const enum { OP_INFIX, OP_PREFIX, OP_POSTFIX } fix;
-} ops[] = {
-# define OP(Kind, Prio, Assoc, Fix, /* Operator string */ ...) \
-    { OP_STRING(__VA_ARGS__), OP_SIZE(__VA_ARGS__), Kind, Prio, Assoc, Fix, },
-#include "operators.inc"
-};
 
 static struct ast_node *climbing_parse_internal(const char **input, int prec);
-static struct ast_node *parse_operand(const char **input);
+static struct ast_node *parse_operand(const char **input, int *r);
 
 static void eat_char(const char **input)
 {
@@ -36,8 +22,7 @@ static void eat_char(const char **input)
 
 static void skip_whitespace(const char **input)
 {
-    while (*input[0] && isspace(*input[0]))
-        eat_char(input);
+    *input = scan_whitespace(*input);
 }
 
 static size_t parse_binop(size_t *op_ind, const char **input)
@@ -106,26 +91,6 @@ static size_t parse_postfix(size_t *op_ind, const char **input)
     return best_len;
 }
 
-static int right_prec(size_t op_ind)
-{
-    if (op_ind >= ARR_SIZE(ops))
-        return INT_MIN; // Defensive programming
-
-    if (ops[op_ind].assoc == ASSOC_RIGHT)
-        return ops[op_ind].prio;
-    return ops[op_ind].prio + 1;
-}
-
-static int next_prec(size_t op_ind)
-{
-    if (op_ind >= ARR_SIZE(ops))
-        return INT_MIN; // Defensive programming
-
-    if (ops[op_ind].assoc != ASSOC_LEFT)
-        return ops[op_ind].prio - 1;
-    return ops[op_ind].prio;
-}
-
 /*
  * Simple climbing parser, see `operators.inc` for more details.
  *
@@ -161,13 +126,13 @@ static size_t update_op(size_t *op_ind, bool *is_binop, const char **input)
 
     const char *save_input = *input;
 
-    size_t op_bin;
+    size_t op_bin = ARR_SIZE(ops); // Invalid operator by default
     size_t bin_size = parse_binop(&op_bin, input);
 
     // Reset the parsing
     *input = save_input;
 
-    size_t op_post;
+    size_t op_post = ARR_SIZE(ops); // Invalid operator by default
     size_t post_size = parse_postfix(&op_post, input);
 
     // Reset the parsing
@@ -190,20 +155,12 @@ static size_t update_op(size_t *op_ind, bool *is_binop, const char **input)
     return 0;
 }
 
-static bool prec_between(size_t op_ind, int min, int max)
-{
-    if (op_ind >= ARR_SIZE(ops))
-        return false; // Defensive programming
-
-    return min <= ops[op_ind].prio && ops[op_ind].prio <= max;
-}
-
 static struct ast_node *climbing_parse_internal(const char **input, int prec)
 {
     prec = prec;
-    struct ast_node *ast = parse_operand(input);
-
     int r = INT_MAX;
+    struct ast_node *ast = parse_operand(input, &r);
+
     size_t len = 0;
     size_t op_ind; // Used in the next loop
     bool is_binop; // Used in the next loop
@@ -240,23 +197,7 @@ static struct ast_node *climbing_parse_internal(const char **input, int prec)
     return ast;
 }
 
-static bool my_atoi(const char **input, int *val)
-{
-    if (!isdigit(*input[0]))
-        return false;
-
-    *val = 0; // Initialize its value
-    do
-    {
-        *val *= 10;
-        *val += *input[0] - '0';
-        *input += 1;
-    } while (isdigit(*input[0]));
-
-    return true;
-}
-
-static struct ast_node *parse_operand(const char **input)
+static struct ast_node *parse_operand(const char **input, int *r)
 {
     struct ast_node *ast = NULL;
 
@@ -266,7 +207,8 @@ static struct ast_node *parse_operand(const char **input)
     if ((skip = parse_prefix(&op_ind, input))) // Removes whitespace as side-effect
     {
         *input += skip; // Skip the parsed operator
-        ast = climbing_parse_internal(input, next_prec(op_ind));
+        // Only operators binding tighter than the prefix are part of its operand
+        ast = climbing_parse_internal(input, ops[op_ind].prio);
 
         if (!ast)
             return NULL;
@@ -274,8 +216,10 @@ static struct ast_node *parse_operand(const char **input)
         if (!tree)
             destroy_ast(ast);
         ast = tree;
+        // Operators binding tighter than the prefix have already been parsed
+        *r = next_prec(op_ind);
     }
-    else if (my_atoi(input, &val))
+    else if (scan_int(input, &val))
         ast = make_num(val);
     else if (*input[0] == '(')
     {
@@ -0,0 +1,40 @@
+#include "operators.h"
+
+#include <limits.h>
+
+#define OP_STRING(...) (const char[]){__VA_ARGS__}
+#define OP_SIZE(...) (sizeof(OP_STRING(__VA_ARGS__)) - 1)
+
+const struct operator ops[NB_OPS] = {
+# define OP(Kind, Prio, Assoc, Fix, /* Operator string */ ...) \
+    { OP_STRING(__VA_ARGS__), OP_SIZE(__VA_ARGS__), Kind, Prio, Assoc, Fix, },
+#include "operators.inc"
+};
+
+int right_prec(size_t op_ind)
+{
+    if (op_ind >= NB_OPS)
+        return INT_MIN; // Defensive programming
+
+    if (ops[op_ind].assoc == ASSOC_RIGHT)
+        return ops[op_ind].prio;
+    return ops[op_ind].prio + 1;
+}
+
+int next_prec(size_t op_ind)
+{
+    if (op_ind >= NB_OPS)
+        return INT_MIN; // Defensive programming
+
+    if (ops[op_ind].assoc != ASSOC_LEFT)
+        return ops[op_ind].prio - 1;
+    return ops[op_ind].prio;
+}
+
+bool prec_between(size_t op_ind, int min, int max)
+{
+    if (op_ind >= NB_OPS)
+        return false; // Defensive programming
+
+    return min <= ops[op_ind].prio && ops[op_ind].prio <= max;
+}
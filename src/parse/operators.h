@@ -0,0 +1,40 @@
+#ifndef OPERATORS_H
+#define OPERATORS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ast/ast.h"
+
+/*
+ * Operators of `operators.inc`, shared by the climbing and streaming parsers
+ * so that both agree on their precedence.
+ */
+enum
+{
+# define OP(Kind, Prio, Assoc, Fix, /* Operator string */ ...) OPERATOR_##Kind,
+#include "operators.inc"
+    NB_OPS,
+};
+
+struct operator
+{
+    const char *op;
+    size_t op_len;
+    enum op_kind kind;
+    int prio;
+    enum { ASSOC_LEFT, ASSOC_RIGHT, ASSOC_NONE } assoc;
+    enum { OP_INFIX, OP_PREFIX, OP_POSTFIX } fix;
+};
+
+extern const struct operator ops[NB_OPS];
+
+// Minimum precedence of the right operand of a binary operator
+int right_prec(size_t op_ind);
+
+// Maximum precedence of the operator following this one
+int next_prec(size_t op_ind);
+
+bool prec_between(size_t op_ind, int min, int max);
+
+#endif /* !OPERATORS_H */
@@ -0,0 +1,281 @@
+#include "parse.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast/ast.h"
+#include "scan.h"
+
+// Inputs are not split in ranges smaller than this
+#define DEFAULT_CUTOFF (1 << 20)
+
+struct parse_job;
+
+/*
+ * Each thread handles a range of the input, parsing the terms which start in
+ * that range. Their trees are joined in a left spine, whose deepest node is
+ * missing its left operand: the tree of the previous ranges.
+ */
+struct range
+{
+    struct parse_job *job;
+    size_t begin;
+    size_t end;
+    long depth; // Parenthesis depth at the start of the range
+    long delta; // Parenthesis depth change over the range
+    long min_depth; // Lowest depth reached, relative to its start
+    struct ast_node *tree;
+    struct ast_node *hole; // Node which should have the previous ranges as lhs
+    size_t offset; // Size of the previous ranges, to be added to the spine
+    bool error;
+};
+
+struct parse_job
+{
+    const char *input;
+    struct range *ranges;
+    size_t nb_ranges;
+    void (*phase)(struct range *range); // Run on each range, in parallel
+};
+
+static bool is_operand_end(char c)
+{
+    return is_digit(c) || c == ')' || c == '!';
+}
+
+static void scan_depth(struct range *range)
+{
+    const char *input = range->job->input;
+
+    for (size_t i = range->begin; i < range->end; ++i)
+    {
+        if (input[i] == '(')
+            range->delta += 1;
+        else if (input[i] == ')' && --range->delta < range->min_depth)
+            range->min_depth = range->delta;
+    }
+}
+
+/*
+ * Find the first binary '+' or '-' outside of parenthesis in the range: one
+ * which follows a complete operand, to tell them apart from unary operators.
+ */
+static const char *find_split(const struct range *range)
+{
+    const char *input = range->job->input;
+    long depth = range->depth;
+    char prev = '\0';
+
+    for (size_t i = range->begin; i > 0; --i)
+    {
+        if (!is_space(input[i - 1]))
+        {
+            prev = input[i - 1];
+            break;
+        }
+    }
+
+    for (size_t i = range->begin; i < range->end; ++i)
+    {
+        const char c = input[i];
+
+        if (c == '(')
+            depth += 1;
+        else if (c == ')')
+            depth -= 1;
+        else if ((c == '+' || c == '-') && depth == 0 && is_operand_end(prev))
+            return input + i;
+
+        if (!is_space(c))
+            prev = c;
+    }
+
+    return NULL;
+}
+
+/*
+ * A term stops on the next split, or at the end of the input, anything else
+ * means that the input is invalid.
+ */
+static bool end_of_term(const char **input)
+{
+    *input = scan_whitespace(*input);
+
+    return *input[0] == '+' || *input[0] == '-' || *input[0] == '\0';
+}
+
+static void parse_terms(struct range *range)
+{
+    const char *end = range->job->input + range->end;
+    const char *input = range->job->input;
+
+    if (range->begin == 0)
+    {
+        range->tree = recursive_parse_term(&input);
+        if (range->tree == NULL || !end_of_term(&input))
+        {
+            range->error = true;
+            return;
+        }
+    }
+    else if ((input = find_split(range)) == NULL)
+        return; // The range is in the middle of a term
+
+    // Later splits are found by parsing the terms which precede them
+    while (input < end && *input != '\0')
+    {
+        const enum op_kind op = *input == '+' ? BINOP_PLUS : BINOP_MINUS;
+
+        input += 1;
+
+        struct ast_node *rhs = recursive_parse_term(&input);
+        struct ast_node *ast = NULL;
+
+        if (rhs == NULL || !end_of_term(&input)
+            || (ast = make_binop(op, range->tree, rhs)) == NULL)
+        {
+            destroy_ast(rhs);
+            range->error = true;
+            return;
+        }
+
+        if (range->tree == NULL)
+            range->hole = ast;
+        range->tree = ast;
+    }
+}
+
+static void fix_sizes(struct range *range)
+{
+    if (range->hole == NULL)
+        return;
+
+    for (struct ast_node *ast = range->tree; ast != range->hole;
+         ast = ast->val.bin_op.lhs)
+        ast->size += range->offset;
+
+    range->hole->size += range->offset;
+}
+
+static void *run_range(void *arg)
+{
+    struct range *range = arg;
+
+    range->job->phase(range);
+
+    return NULL;
+}
+
+static void run_phase(struct parse_job *job, void (*phase)(struct range *range))
+{
+    pthread_t threads[job->nb_ranges];
+    bool started[job->nb_ranges];
+
+    job->phase = phase;
+
+    for (size_t i = 1; i < job->nb_ranges; ++i)
+        started[i] =
+            pthread_create(&threads[i], NULL, run_range, &job->ranges[i]) == 0;
+
+    phase(&job->ranges[0]);
+
+    for (size_t i = 1; i < job->nb_ranges; ++i)
+    {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            phase(&job->ranges[i]); // Could not start a thread, do it here
+    }
+}
+
+/*
+ * Parse the input using up to `nb_threads` threads, each handling ranges of
+ * at least `cutoff` bytes, or a sensible default if 0. The result is identical
+ * to `recursive_parse`.
+ *
+ * The input is split on the '+' and '-' operators found outside of
+ * parenthesis, the terms in between being parsed independently before being
+ * joined left-associatively. A prefix scan of the parenthesis depth is used
+ * to find the split points from each range.
+ */
+struct ast_node *parallel_parse(const char *input, unsigned nb_threads,
+                                size_t cutoff)
+{
+    if (input == NULL)
+        return NULL;
+
+    const size_t len = strlen(input);
+    size_t nb_ranges = len / (cutoff ? cutoff : DEFAULT_CUTOFF);
+
+    if (nb_ranges > nb_threads)
+        nb_ranges = nb_threads;
+    if (nb_ranges <= 1)
+        return recursive_parse(input);
+
+    struct parse_job job = { .input = input, .nb_ranges = nb_ranges };
+    if ((job.ranges = calloc(nb_ranges, sizeof(*job.ranges))) == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < nb_ranges; ++i)
+    {
+        job.ranges[i].job = &job;
+        job.ranges[i].begin = len * i / nb_ranges;
+        job.ranges[i].end = len * (i + 1) / nb_ranges;
+    }
+
+    run_phase(&job, scan_depth);
+
+    bool balanced = true;
+    long depth = 0;
+    for (size_t i = 0; i < nb_ranges; ++i)
+    {
+        job.ranges[i].depth = depth;
+        balanced &= depth + job.ranges[i].min_depth >= 0;
+        depth += job.ranges[i].delta;
+    }
+
+    if (!balanced || depth != 0)
+    {
+        // Unbalanced parenthesis, let the parser report the error
+        free(job.ranges);
+        return recursive_parse(input);
+    }
+
+    run_phase(&job, parse_terms);
+
+    bool error = false;
+    size_t offset = 0;
+    for (size_t i = 0; i < nb_ranges; ++i)
+    {
+        error |= job.ranges[i].error;
+        job.ranges[i].offset = offset;
+        offset += ast_size(job.ranges[i].tree);
+    }
+
+    if (!error)
+        run_phase(&job, fix_sizes);
+
+    struct ast_node *ast = NULL;
+    for (size_t i = 0; i < nb_ranges; ++i)
+    {
+        if (job.ranges[i].tree == NULL)
+            continue;
+
+        // Only the first range has no hole, which is where we start
+        if (job.ranges[i].hole)
+            job.ranges[i].hole->val.bin_op.lhs = ast;
+        ast = job.ranges[i].tree;
+    }
+
+    free(job.ranges);
+
+    if (error)
+    {
+        destroy_ast(ast);
+        return NULL;
+    }
+
+    return ast;
+}
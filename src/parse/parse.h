@@ -1,9 +1,27 @@
 #ifndef PARSE_H
 #define PARSE_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "ast/ast.h"
 
+// Forward declaration
+struct stream_parser;
+
 struct ast_node *climbing_parse(const char *input);
 struct ast_node *recursive_parse(const char *input);
+struct ast_node *recursive_parse_vars(const char *input,
+                                      const char *const *names,
+                                      size_t nb_names);
+struct ast_node *recursive_parse_term(const char **input);
+
+struct ast_node *parallel_parse(const char *input, unsigned nb_threads,
+                                size_t cutoff);
+
+struct stream_parser *make_stream_parser(void);
+bool stream_parse(struct stream_parser *parser, const char *input, size_t len);
+struct ast_node *finish_stream_parser(struct stream_parser *parser);
+void destroy_stream_parser(struct stream_parser *parser);
 
 #endif /* !PARSE_H */
@@ -1,18 +1,45 @@
 #include "parse.h"
 
-#include <ctype.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "ast/ast.h"
+#include "scan.h"
 
 #define UNREACHABLE() __builtin_unreachable()
 
-static struct ast_node *parse_expression(const char **input);
-static struct ast_node *parse_term(const char **input);
-static struct ast_node *parse_factor(const char **input);
-static struct ast_node *parse_power(const char **input);
-static struct ast_node *parse_group(const char **input);
+// Name of a variable bound by the program, in its input
+struct binding
+{
+    const char *name;
+    size_t len;
+};
+
+/*
+ * Names of the variables which can be used, by index: those bound by the
+ * program come after the given ones.
+ */
+struct vars
+{
+    const char *const *names;
+    size_t nb_names;
+    const struct binding *bindings;
+    size_t nb_bindings;
+};
+
+static struct ast_node *parse_expression(const char **input,
+                                         const struct vars *vars);
+static struct ast_node *parse_term(const char **input,
+                                   const struct vars *vars);
+static struct ast_node *parse_factor(const char **input,
+                                     const struct vars *vars);
+static struct ast_node *parse_power(const char **input,
+                                    const struct vars *vars);
+static struct ast_node *parse_group(const char **input,
+                                    const struct vars *vars);
 
 static void eat_char(const char **input)
 {
@@ -21,8 +48,7 @@ static void eat_char(const char **input)
 
 static void skip_whitespace(const char **input)
 {
-    while (*input[0] && isspace(*input[0]))
-        eat_char(input);
+    *input = scan_whitespace(*input);
 }
 
 /*
@@ -32,7 +58,7 @@ static void skip_whitespace(const char **input)
  *      T : F [ ('*'|'/') F ]*
  *      F : [ ('-'|'+') ]* P
  *      P : G [ ('^') F ]*
- *      G : '(' E ')' | CONSTANT [ '!' ]
+ *      G : ( '(' E ')' | CONSTANT | VARIABLE ) [ '!' ]
  *
  * Whitespace is ignored in the input string, only serving to delimit numbers.
  *
@@ -40,12 +66,52 @@ static void skip_whitespace(const char **input)
  * expression in the input results in an error.
  */
 
+static struct ast_node *parse_input(const char *input,
+                                    const struct vars *vars);
+static struct ast_node *parse_program(const char **input,
+                                      const struct vars *vars);
+
 struct ast_node *recursive_parse(const char *input)
 {
+    const struct vars vars = { NULL, 0, NULL, 0 };
+
     if (input == NULL)
         return NULL;
 
-    struct ast_node *ast = parse_expression(&input);
+    return parse_input(input, &vars);
+}
+
+/*
+ * Same as `recursive_parse`, allowing the given variable names to be used in
+ * the expression. Names are made of letters, digits, and underscores, and do
+ * not start with a digit. Unknown names are parse errors.
+ *
+ * The expression can be preceded by bindings, making up a program:
+ *
+ *      PROGRAM : [ VARIABLE '=' E ';' ]* E
+ *
+ * Each binding names a new variable, which can be used in what follows it.
+ * Names cannot be bound twice, nor shadow the given ones.
+ */
+struct ast_node *recursive_parse_vars(const char *input,
+                                      const char *const *names,
+                                      size_t nb_names)
+{
+    const struct vars vars = { names, nb_names, NULL, 0 };
+
+    if (input == NULL)
+        return NULL;
+
+    return parse_program(&input, &vars);
+}
+
+/*
+ * Parse a single expression, making sure that nothing follows it.
+ */
+static struct ast_node *parse_input(const char *input,
+                                    const struct vars *vars)
+{
+    struct ast_node *ast = parse_expression(&input, vars);
 
     if (ast == NULL)
         return NULL;
@@ -61,6 +127,136 @@ struct ast_node *recursive_parse(const char *input)
     return ast;
 }
 
+static bool is_name_char(char c)
+{
+    return is_name_start(c) || is_digit(c);
+}
+
+static size_t name_length(const char *input)
+{
+    size_t len = 0;
+
+    while (is_name_char(input[len]))
+        len += 1;
+
+    return len;
+}
+
+/*
+ * Index of the variable, or `SIZE_MAX` if the name is unknown.
+ */
+static size_t find_variable(const char *name, size_t len,
+                            const struct vars *vars)
+{
+    for (size_t i = 0; i < vars->nb_names; ++i)
+        if (strncmp(name, vars->names[i], len) == 0
+            && vars->names[i][len] == '\0')
+            return i;
+
+    for (size_t i = 0; i < vars->nb_bindings; ++i)
+        if (vars->bindings[i].len == len
+            && memcmp(name, vars->bindings[i].name, len) == 0)
+            return vars->nb_names + i;
+
+    return SIZE_MAX;
+}
+
+/*
+ * Does the input start with a binding, rather than with the result
+ */
+static bool is_binding(const char *input)
+{
+    input = scan_whitespace(input);
+    if (!is_name_start(*input))
+        return false;
+
+    input = scan_whitespace(input + name_length(input));
+    return *input == '=';
+}
+
+/*
+ * Bindings are parsed first, then nested around the result: the body of each
+ * one is the rest of the program. Its variable is the one of index
+ * `nb_names + i` for the `i`-th binding.
+ */
+static struct ast_node *parse_program(const char **input,
+                                      const struct vars *vars)
+{
+    size_t max_bindings = 1;
+    for (const char *it = *input; (it = strchr(it, ';')) != NULL; ++it)
+        max_bindings += 1;
+
+    struct binding *bindings = malloc(max_bindings * sizeof(*bindings));
+    struct ast_node **values = malloc(max_bindings * sizeof(*values));
+    struct vars scope = { vars->names, vars->nb_names, bindings, 0 };
+    struct ast_node *ast = NULL;
+    bool valid = bindings && values;
+
+    while (valid && is_binding(*input))
+    {
+        struct binding *binding = &bindings[scope.nb_bindings];
+
+        binding->name = scan_whitespace(*input);
+        binding->len = name_length(binding->name);
+        if (find_variable(binding->name, binding->len, &scope) != SIZE_MAX)
+        {
+            valid = false; // Already bound
+            break;
+        }
+
+        *input = scan_whitespace(binding->name + binding->len) + 1;
+        values[scope.nb_bindings] = parse_expression(input, &scope);
+        if (values[scope.nb_bindings] == NULL)
+        {
+            valid = false;
+            break;
+        }
+
+        scope.nb_bindings += 1;
+        skip_whitespace(input);
+        valid = *input[0] == ';';
+        eat_char(input);
+    }
+
+    if (valid)
+        ast = parse_input(*input, &scope);
+
+    // Nest the bindings around the result, or free them on errors
+    while (scope.nb_bindings > 0)
+    {
+        scope.nb_bindings -= 1;
+
+        struct ast_node *value = values[scope.nb_bindings];
+        struct ast_node *let =
+            ast ? make_let(vars->nb_names + scope.nb_bindings, value, ast)
+                : NULL;
+
+        if (let == NULL)
+        {
+            destroy_ast(value);
+            destroy_ast(ast);
+        }
+        ast = let;
+    }
+
+    free(values);
+    free(bindings);
+
+    return ast;
+}
+
+/*
+ * Parse a single term, leaving `input` on the first character which is not
+ * part of it. Used to parse each term of an expression independently, see
+ * `parallel_parse`.
+ */
+struct ast_node *recursive_parse_term(const char **input)
+{
+    const struct vars vars = { NULL, 0, NULL, 0 };
+
+    return parse_term(input, &vars);
+}
+
 static enum op_kind char_to_binop(char c)
 {
     switch (c)
@@ -79,9 +275,10 @@ static enum op_kind char_to_binop(char c)
     UNREACHABLE();
 }
 
-static struct ast_node *parse_expression(const char **input)
+static struct ast_node *parse_expression(const char **input,
+                                         const struct vars *vars)
 {
-    struct ast_node *lhs = parse_term(input);
+    struct ast_node *lhs = parse_term(input, vars);
     if (lhs == NULL) // Error occured, abort
         return NULL;
 
@@ -98,7 +295,7 @@ static struct ast_node *parse_expression(const char **input)
 
             eat_char(input);
 
-            struct ast_node *rhs = parse_term(input);
+            struct ast_node *rhs = parse_term(input, vars);
 
             if (rhs == NULL) // Error occured
             {
@@ -115,9 +312,10 @@ static struct ast_node *parse_expression(const char **input)
     return lhs;
 }
 
-static struct ast_node *parse_term(const char **input)
+static struct ast_node *parse_term(const char **input,
+                                   const struct vars *vars)
 {
-    struct ast_node *lhs = parse_factor(input);
+    struct ast_node *lhs = parse_factor(input, vars);
     if (lhs == NULL) // Error occured, abort
         return NULL;
 
@@ -134,7 +332,7 @@ static struct ast_node *parse_term(const char **input)
 
             eat_char(input);
 
-            struct ast_node *rhs = parse_factor(input);
+            struct ast_node *rhs = parse_factor(input, vars);
 
             if (rhs == NULL) // Error occured
             {
@@ -165,7 +363,8 @@ static enum op_kind char_to_unop(char c)
     UNREACHABLE();
 }
 
-static struct ast_node *parse_factor(const char **input)
+static struct ast_node *parse_factor(const char **input,
+                                     const struct vars *vars)
 {
     skip_whitespace(input); // Whitespace is not significant
     while (*input[0] == '+' || *input[0] == '-')
@@ -174,19 +373,20 @@ static struct ast_node *parse_factor(const char **input)
 
         eat_char(input);
 
-        struct ast_node *rhs = parse_factor(input); // Loop by recursion
+        struct ast_node *rhs = parse_factor(input, vars); // Loop by recursion
 
         if (rhs == NULL)
             return NULL;
 
         return make_unop(op, rhs);
     }
-    return parse_power(input);
+    return parse_power(input, vars);
 }
 
-static struct ast_node *parse_power(const char **input)
+static struct ast_node *parse_power(const char **input,
+                                    const struct vars *vars)
 {
-    struct ast_node *lhs = parse_group(input);
+    struct ast_node *lhs = parse_group(input, vars);
     if (lhs == NULL) // Error occured, abort
         return NULL;
 
@@ -201,7 +401,7 @@ static struct ast_node *parse_power(const char **input)
 
         eat_char(input);
 
-        struct ast_node *rhs = parse_factor(input);
+        struct ast_node *rhs = parse_factor(input, vars);
 
         if (rhs == NULL) // Error occured
         {
@@ -215,35 +415,35 @@ static struct ast_node *parse_power(const char **input)
     return lhs;
 }
 
-static bool my_atoi(const char **input, int *val)
+static struct ast_node *parse_variable(const char **input,
+                                       const struct vars *vars)
 {
-    if (!isdigit(*input[0]))
-        return false;
+    size_t len = name_length(*input);
+    size_t var = find_variable(*input, len, vars);
 
-    *val = 0; // Initialize its value
-    do
-    {
-        *val *= 10;
-        *val += *input[0] - '0';
-        *input += 1;
-    } while (isdigit(*input[0]));
+    if (var == SIZE_MAX)
+        return NULL; // Unknown variable
 
-    return true;
+    *input += len;
+    return make_var(var);
 }
 
-static struct ast_node *parse_group(const char **input)
+static struct ast_node *parse_group(const char **input,
+                                    const struct vars *vars)
 {
     skip_whitespace(input); // Whitespace is not significant
     struct ast_node *ast = NULL;
 
     int val = 0;
-    if (my_atoi(input, &val))
+    if (scan_int(input, &val))
         ast = make_num(val);
+    else if (is_name_start(*input[0]))
+        ast = parse_variable(input, vars);
     else if (*input[0] == '(')
     {
         // Remove the parenthesis
         eat_char(input);
-        ast = parse_expression(input);
+        ast = parse_expression(input, vars);
         // Check that we have our closing parenthesis
         skip_whitespace(input);
         if (*input[0] != ')')
@@ -253,9 +453,11 @@ static struct ast_node *parse_group(const char **input)
         }
         // Remove the parenthesis
         eat_char(input);
-        return ast;
     }
 
+    if (ast == NULL) // Not a number, a variable, nor a parenthesized expression
+        return NULL;
+
     skip_whitespace(input);
     if (*input[0] == '!')
     {
@@ -0,0 +1,349 @@
+#include "scan.h"
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+# define HAVE_SSE2 1
+# include <immintrin.h>
+#else
+# define HAVE_SSE2 0
+#endif
+
+// Compiled on any x86 CPU, used only if supported at runtime
+#if defined(__x86_64__) || defined(__i386__)
+# define HAVE_AVX2 1
+# include <immintrin.h>
+#else
+# define HAVE_AVX2 0
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+# define HAVE_SWAR 1
+#else
+# define HAVE_SWAR 0
+#endif
+
+/*
+ * The kernels read whole aligned blocks, which cannot cross a page boundary:
+ * they might read past the end of the string, but never past the end of the
+ * page containing its terminating NUL.
+ */
+#define BLOCK_READ __attribute__((no_sanitize_address))
+
+#define ARR_SIZE(Arr) (sizeof(Arr) / sizeof(*Arr))
+
+static const char *whitespace_bytes(const char *input)
+{
+    while (is_space(*input))
+        input += 1;
+    return input;
+}
+
+static const char *digits_bytes(const char *input)
+{
+    while (is_digit(*input))
+        input += 1;
+    return input;
+}
+
+#if HAVE_SWAR
+typedef uint64_t __attribute__((may_alias)) word_t;
+
+# define ONES ((word_t)0x0101010101010101)
+# define HIGH_BITS (ONES * 0x80)
+# define LOW_BITS (ONES * 0x7F)
+
+/*
+ * Set the high bit of each byte which is between `low` and `high` included.
+ * Working on the low 7 bits of each byte, additions never carry over to the
+ * next byte.
+ */
+static word_t in_range(word_t word, unsigned char low, unsigned char high)
+{
+    word_t low_bits = word & LOW_BITS;
+    word_t above_low = low_bits + ONES * (0x80 - low);
+    word_t above_high = low_bits + ONES * (0x80 - high - 1);
+
+    return above_low & ~above_high & ~word & HIGH_BITS;
+}
+
+static word_t space_mask_swar(word_t word)
+{
+    return in_range(word, ' ', ' ') | in_range(word, '\t', '\r');
+}
+
+static word_t digit_mask_swar(word_t word)
+{
+    return in_range(word, '0', '9');
+}
+
+BLOCK_READ static const char *scan_swar(const char *input,
+                                        word_t (*mask)(word_t word))
+{
+    const word_t *block = (const word_t *)((uintptr_t)input & ~(uintptr_t)7);
+    unsigned offset = (uintptr_t)input & 7;
+
+    // Ignore the bytes before the start of the input
+    word_t others = ~mask(*block) & HIGH_BITS & (~(word_t)0 << (8 * offset));
+    while (others == 0)
+        others = ~mask(*++block) & HIGH_BITS;
+
+    return (const char *)block + __builtin_ctzll(others) / 8;
+}
+
+static const char *whitespace_swar(const char *input)
+{
+    return scan_swar(input, space_mask_swar);
+}
+
+static const char *digits_swar(const char *input)
+{
+    return scan_swar(input, digit_mask_swar);
+}
+
+/*
+ * Convert 8 digits at once, by combining pairs of digits, then pairs of pairs,
+ * and so on using multiplications.
+ */
+static uint32_t convert_eight_digits(const char *input)
+{
+    uint64_t val = 0;
+
+    for (size_t i = 0; i < sizeof(val); ++i)
+        val |= (uint64_t)(unsigned char)input[i] << (8 * i);
+
+    val = (val & 0x0F0F0F0F0F0F0F0F) * (10 * (1 << 8) + 1) >> 8;
+    val = (val & 0x00FF00FF00FF00FF) * (100 * (1 << 16) + 1) >> 16;
+    return (val & 0x0000FFFF0000FFFF) * (10000 * (UINT64_C(1) << 32) + 1) >> 32;
+}
+#endif
+
+#if HAVE_SSE2
+/*
+ * '\t' to '\r' are contiguous, check them by subtracting '\t' then comparing
+ * as unsigned using the minimum.
+ */
+static __m128i in_range_sse2(__m128i chunk, char low, char high)
+{
+    __m128i offset = _mm_sub_epi8(chunk, _mm_set1_epi8(low));
+    __m128i min = _mm_min_epu8(offset, _mm_set1_epi8(high - low));
+
+    return _mm_cmpeq_epi8(min, offset);
+}
+
+static unsigned space_mask_sse2(__m128i chunk)
+{
+    __m128i space = _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' '));
+
+    return _mm_movemask_epi8(
+        _mm_or_si128(space, in_range_sse2(chunk, '\t', '\r')));
+}
+
+static unsigned digit_mask_sse2(__m128i chunk)
+{
+    return _mm_movemask_epi8(in_range_sse2(chunk, '0', '9'));
+}
+
+BLOCK_READ static const char *scan_sse2(const char *input,
+                                        unsigned (*mask)(__m128i chunk))
+{
+    const __m128i *block = (const __m128i *)((uintptr_t)input & ~(uintptr_t)15);
+    unsigned offset = (uintptr_t)input & 15;
+
+    // Ignore the bytes before the start of the input
+    unsigned others = ~mask(_mm_load_si128(block)) & (0xFFFFu << offset);
+    while ((others & 0xFFFF) == 0)
+        others = ~mask(_mm_load_si128(++block));
+
+    return (const char *)block + __builtin_ctz(others);
+}
+
+static const char *whitespace_sse2(const char *input)
+{
+    return scan_sse2(input, space_mask_sse2);
+}
+
+static const char *digits_sse2(const char *input)
+{
+    return scan_sse2(input, digit_mask_sse2);
+}
+#endif
+
+#if HAVE_AVX2
+# define AVX2 __attribute__((target("avx2")))
+
+AVX2 static __m256i in_range_avx2(__m256i chunk, char low, char high)
+{
+    __m256i offset = _mm256_sub_epi8(chunk, _mm256_set1_epi8(low));
+    __m256i min = _mm256_min_epu8(offset, _mm256_set1_epi8(high - low));
+
+    return _mm256_cmpeq_epi8(min, offset);
+}
+
+/*
+ * Both kernels are written out in full, calls through function pointers could
+ * not be inlined into the loop.
+ */
+AVX2 BLOCK_READ static const char *whitespace_avx2(const char *input)
+{
+    const __m256i *block = (const __m256i *)((uintptr_t)input & ~(uintptr_t)31);
+    unsigned offset = (uintptr_t)input & 31;
+    uint32_t others = 0;
+
+    do
+    {
+        __m256i chunk = _mm256_load_si256(block++);
+        __m256i space = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' '));
+        __m256i ctrl = in_range_avx2(chunk, '\t', '\r');
+
+        others = ~_mm256_movemask_epi8(_mm256_or_si256(space, ctrl));
+        others &= ~(uint32_t)0 << offset; // Only for the first block
+        offset = 0;
+    } while (others == 0);
+
+    return (const char *)(block - 1) + __builtin_ctz(others);
+}
+
+AVX2 BLOCK_READ static const char *digits_avx2(const char *input)
+{
+    const __m256i *block = (const __m256i *)((uintptr_t)input & ~(uintptr_t)31);
+    unsigned offset = (uintptr_t)input & 31;
+    uint32_t others = 0;
+
+    do
+    {
+        __m256i chunk = _mm256_load_si256(block++);
+
+        others = ~_mm256_movemask_epi8(in_range_avx2(chunk, '0', '9'));
+        others &= ~(uint32_t)0 << offset; // Only for the first block
+        offset = 0;
+    } while (others == 0);
+
+    return (const char *)(block - 1) + __builtin_ctz(others);
+}
+#endif
+
+static const struct
+{
+    const char *(*whitespace)(const char *input);
+    const char *(*digits)(const char *input);
+    bool swar_convert; // Convert numbers 8 digits at a time
+} kernels[] = {
+    [SCAN_BYTES] = { whitespace_bytes, digits_bytes, false },
+#if HAVE_SWAR
+    [SCAN_SWAR] = { whitespace_swar, digits_swar, true },
+#endif
+#if HAVE_SSE2
+    [SCAN_SSE2] = { whitespace_sse2, digits_sse2, HAVE_SWAR },
+#endif
+#if HAVE_AVX2
+    [SCAN_AVX2] = { whitespace_avx2, digits_avx2, HAVE_SWAR },
+#endif
+};
+
+static enum scan_kernel current = SCAN_BYTES;
+
+bool set_scan_kernel(enum scan_kernel kernel)
+{
+    if (kernel >= ARR_SIZE(kernels) || kernels[kernel].whitespace == NULL)
+        return false;
+
+#if HAVE_AVX2
+    __builtin_cpu_init();
+    if (kernel == SCAN_AVX2 && !__builtin_cpu_supports("avx2"))
+        return false;
+#endif
+
+    current = kernel;
+    return true;
+}
+
+enum scan_kernel get_scan_kernel(void)
+{
+    return current;
+}
+
+// Pick the fastest kernel before any thread has the chance to parse anything
+__attribute__((constructor)) static void init_scan_kernel(void)
+{
+    for (size_t i = ARR_SIZE(kernels); i > 0; --i)
+        if (set_scan_kernel(i - 1))
+            break;
+}
+
+const char *scan_whitespace(const char *input)
+{
+    // Most runs are a single character, do not bother with the kernels
+    if (!is_space(*input))
+        return input;
+    if (!is_space(input[1]))
+        return input + 1;
+
+    return kernels[current].whitespace(input + 2);
+}
+
+/*
+ * Scan the digits of a number which fits in `limit`, `input` being left
+ * untouched otherwise.
+ */
+static bool scan_bounded(const char **input, uint64_t limit, uint64_t *val)
+{
+    const char *start = *input;
+
+    if (!is_digit(*start))
+        return false;
+
+    const char *end = kernels[current].digits(start + 1);
+
+    // Leading zeros do not count towards the size of the number
+    while (*start == '0' && start + 1 < end)
+        start += 1;
+
+    // Would not fit an `int` for sure
+    if (end - start > 10)
+        return false;
+
+    uint64_t num = 0;
+#if HAVE_SWAR
+    if (kernels[current].swar_convert)
+        for (; end - start >= 8; start += 8)
+            num = num * 100000000 + convert_eight_digits(start);
+#endif
+    for (; start < end; ++start)
+        num = num * 10 + (*start - '0');
+
+    if (num > limit)
+        return false;
+
+    *val = num;
+    *input = end;
+    return true;
+}
+
+bool scan_int(const char **input, int *val)
+{
+    uint64_t num = 0;
+
+    if (!scan_bounded(input, INT_MAX, &num))
+        return false;
+
+    *val = num;
+    return true;
+}
+
+/*
+ * The sign was already scanned: the magnitude of `INT_MIN` is one more than
+ * `INT_MAX`.
+ */
+bool scan_signed_int(const char **input, bool negative, int *val)
+{
+    uint64_t num = 0;
+
+    if (!scan_bounded(input, (uint64_t)INT_MAX + negative, &num))
+        return false;
+
+    *val = negative ? (int)-(int64_t)num : (int)num;
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdbool.h>
+
+/*
+ * Kernels used to scan whitespace and numbers, the fastest one supported by
+ * the CPU is used by default.
+ */
+enum scan_kernel
+{
+    SCAN_BYTES, // One character at a time
+    SCAN_SWAR, // 8 characters at a time in a general purpose register
+    SCAN_SSE2, // 16 characters at a time
+    SCAN_AVX2, // 32 characters at a time
+};
+
+/*
+ * Same as `isspace`, `isdigit` and `isalpha` or '_' in the "C" locale, using a
+ * single unsigned comparison for each range.
+ */
+static inline bool is_space(char c)
+{
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+static inline bool is_digit(char c)
+{
+    return (unsigned char)(c - '0') <= 9;
+}
+
+static inline bool is_name_start(char c)
+{
+    return c == '_' || (unsigned char)((c | 0x20) - 'a') <= 'z' - 'a';
+}
+
+// Returns false if the kernel is not supported, keeping the current one
+bool set_scan_kernel(enum scan_kernel kernel);
+enum scan_kernel get_scan_kernel(void);
+
+// Returns a pointer to the first non-whitespace character
+const char *scan_whitespace(const char *input);
+
+// Returns false if there is no number, or if it does not fit in an `int`
+bool scan_int(const char **input, int *val);
+
+// Same as above for the digits of a number of the given sign
+bool scan_signed_int(const char **input, bool negative, int *val);
+
+#endif /* !SCAN_H */
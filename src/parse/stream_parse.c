@@ -0,0 +1,506 @@
+#include "parse.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast/ast.h"
+#include "operators.h"
+#include "scan.h"
+
+#define ARR_SIZE(Arr) (sizeof(Arr) / sizeof(*Arr))
+#define OP_STRING(...) (const char[]){__VA_ARGS__}
+
+// Its size is the one of the longest operator string, terminator included
+union max_op_len {
+# define OP(Kind, Prio, Assoc, Fix, /* Operator string */ ...) \
+    char Kind[sizeof(OP_STRING(__VA_ARGS__))];
+#include "operators.inc"
+};
+
+/*
+ * Each frame corresponds to one call of `climbing_parse_internal` in the
+ * climbing parser, the recursion is replaced by an explicit stack.
+ */
+struct frame
+{
+    struct ast_node *ast;
+    int prec; // Minimum precedence of operators parsed by this frame
+    int r; // Maximum precedence of the next operator
+    enum frame_state
+    {
+        EXPECT_OPERAND,
+        EXPECT_OPERATOR,
+        EXPECT_RPAREN,
+    } state;
+    enum frame_wait // What the frame above this one is being parsed for
+    {
+        WAIT_NONE,
+        WAIT_PREFIX,
+        WAIT_BINOP,
+        WAIT_PAREN,
+    } wait;
+    size_t op_ind; // Operator used when waiting on a prefix or binary operand
+};
+
+struct token
+{
+    enum token_kind
+    {
+        TOK_NUM,
+        TOK_OP,
+        TOK_LPAREN,
+        TOK_RPAREN,
+        TOK_OTHER,
+        TOK_END,
+    } kind;
+    int num;
+    size_t op_ind;
+};
+
+struct stream_parser
+{
+    struct frame *frames;
+    size_t depth;
+    size_t capacity;
+    enum
+    {
+        LEX_NONE,
+        LEX_NUMBER,
+        LEX_OPERATOR,
+    } lex;
+    int num; // Number being lexed, possibly across chunks
+    char pending[sizeof(union max_op_len)]; // Operator being lexed
+    size_t pending_len;
+    bool error;
+    bool done;
+};
+
+static struct frame *top_frame(struct stream_parser *parser)
+{
+    return &parser->frames[parser->depth - 1];
+}
+
+static bool push_frame(struct stream_parser *parser, int prec)
+{
+    if (parser->depth == parser->capacity)
+    {
+        size_t capacity = parser->capacity ? parser->capacity * 2 : 16;
+        struct frame *frames =
+            realloc(parser->frames, capacity * sizeof(*frames));
+
+        if (!frames)
+            return false;
+
+        parser->frames = frames;
+        parser->capacity = capacity;
+    }
+
+    parser->frames[parser->depth++] = (struct frame){
+        .ast = NULL,
+        .prec = prec,
+        .r = INT_MAX,
+        .state = EXPECT_OPERAND,
+        .wait = WAIT_NONE,
+        .op_ind = ARR_SIZE(ops),
+    };
+
+    return true;
+}
+
+static bool is_candidate(size_t op_ind, enum frame_state state)
+{
+    if (state == EXPECT_OPERAND)
+        return ops[op_ind].fix == OP_PREFIX;
+    return ops[op_ind].fix != OP_PREFIX;
+}
+
+/*
+ * Return the length of the operator found at the start of `input`, following
+ * the same rules as `climbing_parse`.
+ */
+static size_t match_op(const char *input, size_t len, enum frame_state state,
+                       size_t *op_ind)
+{
+    size_t best_len[3] = { 0 };
+    size_t best_op[3] = { ARR_SIZE(ops), ARR_SIZE(ops), ARR_SIZE(ops) };
+
+    for (size_t i = 0; i < ARR_SIZE(ops); ++i)
+    {
+        if (!is_candidate(i, state))
+            continue;
+        if (ops[i].op_len <= best_len[ops[i].fix] || ops[i].op_len > len)
+            continue;
+        if (strncmp(input, ops[i].op, ops[i].op_len) == 0)
+        {
+            best_len[ops[i].fix] = ops[i].op_len;
+            best_op[ops[i].fix] = i;
+        }
+    }
+
+    if (state == EXPECT_OPERAND)
+    {
+        *op_ind = best_op[OP_PREFIX];
+        return best_len[OP_PREFIX];
+    }
+
+    // An infix and a postfix operator of the same length cancel each other
+    if (best_len[OP_INFIX] > best_len[OP_POSTFIX])
+    {
+        *op_ind = best_op[OP_INFIX];
+        return best_len[OP_INFIX];
+    }
+    if (best_len[OP_POSTFIX] > best_len[OP_INFIX])
+    {
+        *op_ind = best_op[OP_POSTFIX];
+        return best_len[OP_POSTFIX];
+    }
+    return 0;
+}
+
+/*
+ * Return the length of the longest operator starting with the input, or 0
+ */
+static size_t longest_op(const char *input, size_t len, enum frame_state state)
+{
+    size_t ret = 0;
+    for (size_t i = 0; i < ARR_SIZE(ops); ++i)
+    {
+        if (!is_candidate(i, state))
+            continue;
+        if (ops[i].op_len >= len && ops[i].op_len > ret
+            && strncmp(input, ops[i].op, len) == 0)
+            ret = ops[i].op_len;
+    }
+    return ret;
+}
+
+/*
+ * Give the finished frame's tree to the frame which was waiting for it.
+ */
+static bool return_frame(struct stream_parser *parser)
+{
+    struct ast_node *ast = top_frame(parser)->ast;
+    parser->depth -= 1;
+
+    struct frame *frame = top_frame(parser);
+    size_t op_ind = frame->op_ind;
+    struct ast_node *tree = NULL;
+
+    switch (frame->wait)
+    {
+    case WAIT_PREFIX:
+        tree = make_unop(ops[op_ind].kind, ast);
+        frame->r = next_prec(op_ind);
+        break;
+    case WAIT_BINOP:
+        tree = make_binop(ops[op_ind].kind, frame->ast, ast);
+        frame->r = next_prec(op_ind);
+        break;
+    case WAIT_PAREN:
+        frame->ast = ast;
+        frame->state = EXPECT_RPAREN;
+        frame->wait = WAIT_NONE;
+        return true;
+    case WAIT_NONE:
+        break; // Defensive programming
+    }
+
+    frame->wait = WAIT_NONE;
+    if (!tree)
+    {
+        destroy_ast(ast); // Error case, the frame's tree is destroyed later
+        return false;
+    }
+
+    frame->ast = tree;
+    frame->state = EXPECT_OPERATOR;
+    return true;
+}
+
+static bool handle_operand(struct stream_parser *parser,
+                           const struct token *tok)
+{
+    struct frame *frame = top_frame(parser);
+
+    switch (tok->kind)
+    {
+    case TOK_OP:
+        frame->wait = WAIT_PREFIX;
+        frame->op_ind = tok->op_ind;
+        return push_frame(parser, ops[tok->op_ind].prio);
+    case TOK_NUM:
+        frame->ast = make_num(tok->num);
+        frame->state = EXPECT_OPERATOR;
+        return frame->ast != NULL;
+    case TOK_LPAREN:
+        frame->wait = WAIT_PAREN;
+        return push_frame(parser, 0);
+    default:
+        return false;
+    }
+}
+
+static bool handle_token(struct stream_parser *parser, const struct token *tok)
+{
+    while (true)
+    {
+        struct frame *frame = top_frame(parser);
+
+        switch (frame->state)
+        {
+        case EXPECT_OPERAND:
+            return handle_operand(parser, tok);
+        case EXPECT_RPAREN:
+            frame->state = EXPECT_OPERATOR;
+            return tok->kind == TOK_RPAREN;
+        case EXPECT_OPERATOR:
+            break;
+        }
+
+        if (tok->kind == TOK_OP
+            && prec_between(tok->op_ind, frame->prec, frame->r))
+        {
+            size_t op_ind = tok->op_ind;
+            if (ops[op_ind].fix == OP_INFIX)
+            {
+                frame->wait = WAIT_BINOP;
+                frame->op_ind = op_ind;
+                return push_frame(parser, right_prec(op_ind));
+            }
+
+            struct ast_node *tree = make_unop(ops[op_ind].kind, frame->ast);
+            if (!tree)
+                return false;
+            frame->ast = tree;
+            frame->r = next_prec(op_ind);
+            return true;
+        }
+
+        if (tok->kind != TOK_OP && tok->kind != TOK_RPAREN
+            && tok->kind != TOK_END)
+            return false; // Nothing can ever accept this token
+
+        if (parser->depth == 1)
+        {
+            // Only whitespace is allowed after the expression
+            parser->done = tok->kind == TOK_END;
+            return parser->done;
+        }
+
+        // Let the parent frame look at the same token
+        if (!return_frame(parser))
+            return false;
+    }
+}
+
+static bool emit(struct stream_parser *parser, enum token_kind kind,
+                 size_t op_ind)
+{
+    struct token tok = { .kind = kind, .num = parser->num, .op_ind = op_ind };
+
+    if (!handle_token(parser, &tok))
+        parser->error = true;
+
+    return !parser->error;
+}
+
+static bool lex_char(struct stream_parser *parser, char c);
+
+/*
+ * Emit the longest operator which was lexed, and lex the leftovers again.
+ */
+static bool flush_pending(struct stream_parser *parser)
+{
+    char pending[sizeof(parser->pending)];
+    size_t pending_len = parser->pending_len;
+    memcpy(pending, parser->pending, pending_len);
+
+    parser->lex = LEX_NONE;
+    parser->pending_len = 0;
+
+    size_t op_ind;
+    size_t len =
+        match_op(pending, pending_len, top_frame(parser)->state, &op_ind);
+    if (len == 0)
+        return emit(parser, TOK_OTHER, 0);
+    if (!emit(parser, TOK_OP, op_ind))
+        return false;
+
+    for (size_t i = len; i < pending_len; ++i)
+        if (!lex_char(parser, pending[i]))
+            return false;
+
+    return true;
+}
+
+/*
+ * Numbers which do not fit in an `int` are errors.
+ */
+static bool lex_digit(struct stream_parser *parser, char c)
+{
+    if (parser->num > (INT_MAX - (c - '0')) / 10)
+    {
+        parser->error = true;
+        return false;
+    }
+
+    parser->num = parser->num * 10 + (c - '0');
+    return true;
+}
+
+static bool lex_char(struct stream_parser *parser, char c)
+{
+    if (parser->lex == LEX_NUMBER)
+    {
+        if (is_digit(c))
+            return lex_digit(parser, c);
+
+        parser->lex = LEX_NONE;
+        if (!emit(parser, TOK_NUM, 0))
+            return false;
+    }
+
+    enum frame_state state = top_frame(parser)->state;
+
+    if (parser->lex == LEX_OPERATOR)
+    {
+        parser->pending[parser->pending_len] = c;
+        size_t longest =
+            longest_op(parser->pending, parser->pending_len + 1, state);
+        if (longest > parser->pending_len)
+        {
+            parser->pending_len += 1;
+            // Do not wait for the next character if it cannot change anything
+            if (longest == parser->pending_len)
+                return flush_pending(parser);
+            return true;
+        }
+
+        if (!flush_pending(parser))
+            return false;
+        state = top_frame(parser)->state;
+    }
+
+    if (is_space(c))
+        return true;
+
+    if (state == EXPECT_OPERAND && is_digit(c))
+    {
+        parser->lex = LEX_NUMBER;
+        parser->num = c - '0';
+        return true;
+    }
+
+    size_t longest = longest_op(&c, 1, state);
+    if (longest > 0)
+    {
+        parser->lex = LEX_OPERATOR;
+        parser->pending[0] = c;
+        parser->pending_len = 1;
+        // Do not wait for the next character if it cannot change anything
+        if (longest == 1)
+            return flush_pending(parser);
+        return true;
+    }
+
+    if (c == '(')
+        return emit(parser, TOK_LPAREN, 0);
+    if (c == ')')
+        return emit(parser, TOK_RPAREN, 0);
+    return emit(parser, TOK_OTHER, 0);
+}
+
+/*
+ * Push-style variant of the climbing parser, accepting its input in chunks of
+ * arbitrary sizes. Numbers and operators can be split across chunks.
+ *
+ * The tree is built while the input is being fed, the parser only keeps the
+ * partially built tree along with one frame per nesting level.
+ */
+struct stream_parser *make_stream_parser(void)
+{
+    struct stream_parser *ret = calloc(1, sizeof(*ret));
+
+    if (ret == NULL)
+        return ret;
+
+    if (!push_frame(ret, 0))
+    {
+        free(ret);
+        return NULL;
+    }
+
+    return ret;
+}
+
+/*
+ * Returns false if the input is known to be invalid, no more input should be
+ * fed to the parser in that case.
+ */
+bool stream_parse(struct stream_parser *parser, const char *input, size_t len)
+{
+    if (parser == NULL || parser->error)
+        return false;
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        // Fast paths for the most common characters
+        if (parser->lex == LEX_NUMBER && is_digit(input[i]))
+        {
+            if (!lex_digit(parser, input[i]))
+                return false;
+        }
+        else if (parser->lex == LEX_NONE && is_space(input[i]))
+            continue;
+        else if (!lex_char(parser, input[i]))
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * Signal the end of the input, and return the parsed tree or NULL on error.
+ *
+ * The parser is destroyed in both cases.
+ */
+struct ast_node *finish_stream_parser(struct stream_parser *parser)
+{
+    if (parser == NULL)
+        return NULL;
+
+    if (!parser->error && parser->lex == LEX_NUMBER)
+    {
+        parser->lex = LEX_NONE;
+        emit(parser, TOK_NUM, 0);
+    }
+    if (!parser->error && parser->lex == LEX_OPERATOR)
+        flush_pending(parser);
+    if (!parser->error)
+        emit(parser, TOK_END, 0);
+
+    struct ast_node *ast = NULL;
+    if (parser->done)
+    {
+        ast = parser->frames[0].ast;
+        parser->frames[0].ast = NULL;
+    }
+
+    destroy_stream_parser(parser);
+    return ast;
+}
+
+void destroy_stream_parser(struct stream_parser *parser)
+{
+    if (parser == NULL)
+        return;
+
+    for (size_t i = 0; i < parser->depth; ++i)
+        destroy_ast(parser->frames[i].ast);
+
+    free(parser->frames);
+    free(parser);
+}
@@ -0,0 +1,332 @@
+#define _XOPEN_SOURCE 600 // For `posix_openpt`
+
+#include <criterion/criterion.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "io/async_io.h"
+
+// Several times the size of all the buffers
+#define DATA_SIZE 1000003
+
+static const enum io_backend all_backends[] = { IO_AUTO, IO_URING, IO_EPOLL };
+
+// Writes to closed pipes should fail with EPIPE instead
+static void ignore_sigpipe(void)
+{
+    signal(SIGPIPE, SIG_IGN);
+}
+
+TestSuite(async_io, .init = ignore_sigpipe);
+
+struct pipe_end
+{
+    int fd;
+    char *data;
+    size_t len;
+    size_t chunk; // Size of each write
+};
+
+static char *make_data(void)
+{
+    char *data = malloc(DATA_SIZE);
+
+    cr_assert_not_null(data);
+    for (size_t i = 0; i < DATA_SIZE; ++i)
+        data[i] = "0123456789 +-*/()\n"[(i * 7 + i / 13) % 18];
+
+    return data;
+}
+
+static void *produce(void *arg)
+{
+    struct pipe_end *end = arg;
+
+    for (size_t i = 0; i < end->len;)
+    {
+        size_t size = end->len - i < end->chunk ? end->len - i : end->chunk;
+        ssize_t res = write(end->fd, end->data + i, size);
+
+        if (res <= 0)
+            break;
+        i += res;
+    }
+    close(end->fd);
+
+    return NULL;
+}
+
+static void *consume(void *arg)
+{
+    struct pipe_end *end = arg;
+    ssize_t res;
+
+    end->len = 0;
+    while ((res = read(end->fd, end->data + end->len, DATA_SIZE + 1 - end->len))
+           > 0)
+        end->len += res;
+
+    return NULL;
+}
+
+/*
+ * Copy the input to the output, returns false if the backend is unavailable.
+ */
+static bool copy(int in_fd, int out_fd, enum io_backend backend)
+{
+    struct async_io *io = make_async_io(in_fd, out_fd, backend);
+    const char *data = NULL;
+    size_t len = 0;
+
+    if (io == NULL)
+        return false;
+
+    // Odd sizes to write across the buffers' boundaries
+    while ((data = async_read(io, &len)) != NULL)
+    {
+        for (size_t i = 0; i < len; i += 1000)
+        {
+            size_t size = len - i < 1000 ? len - i : 1000;
+            cr_assert(async_write(io, data + i, size));
+        }
+    }
+
+    cr_assert(destroy_async_io(io));
+
+    return true;
+}
+
+static void pipe_roundtrip(enum io_backend backend, size_t chunk)
+{
+    char *data = make_data();
+    char *output = malloc(DATA_SIZE + 1);
+    int in[2];
+    int out[2];
+    pthread_t producer;
+    pthread_t consumer;
+
+    cr_assert_not_null(output);
+    cr_assert_eq(pipe(in), 0);
+    cr_assert_eq(pipe(out), 0);
+
+    struct pipe_end input = { in[1], data, DATA_SIZE, chunk };
+    struct pipe_end result = { out[0], output, 0, 0 };
+    cr_assert_eq(pthread_create(&producer, NULL, produce, &input), 0);
+    cr_assert_eq(pthread_create(&consumer, NULL, consume, &result), 0);
+
+    bool available = copy(in[0], out[1], backend);
+    close(in[0]);
+    close(out[1]);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    close(out[0]);
+
+    if (available)
+    {
+        cr_assert_eq(result.len, DATA_SIZE, "backend %d", backend);
+        cr_assert(memcmp(output, data, DATA_SIZE) == 0, "backend %d", backend);
+    }
+
+    free(output);
+    free(data);
+}
+
+Test(async_io, pipe_large_writes)
+{
+    for (size_t i = 0; i < sizeof(all_backends) / sizeof(*all_backends); ++i)
+        pipe_roundtrip(all_backends[i], DATA_SIZE);
+}
+
+// Short reads break the chains of reads, which must be submitted again
+Test(async_io, pipe_short_writes)
+{
+    for (size_t i = 0; i < sizeof(all_backends) / sizeof(*all_backends); ++i)
+        pipe_roundtrip(all_backends[i], 777);
+}
+
+Test(async_io, files)
+{
+    for (size_t i = 0; i < sizeof(all_backends) / sizeof(*all_backends); ++i)
+    {
+        char *data = make_data();
+        FILE *in = tmpfile();
+        FILE *out = tmpfile();
+
+        cr_assert(in && out);
+        cr_assert_eq(fwrite(data, 1, DATA_SIZE, in), DATA_SIZE);
+        fflush(in);
+        rewind(in);
+
+        if (copy(fileno(in), fileno(out), all_backends[i]))
+        {
+            char *output = malloc(DATA_SIZE + 1);
+
+            cr_assert_not_null(output);
+            rewind(out);
+            cr_assert_eq(fread(output, 1, DATA_SIZE + 1, out), DATA_SIZE);
+            cr_assert(memcmp(output, data, DATA_SIZE) == 0);
+            free(output);
+        }
+
+        fclose(out);
+        fclose(in);
+        free(data);
+    }
+}
+
+/*
+ * Reading starts at the current position, and stops right at the end of the
+ * file when its size is a multiple of the size of the buffers.
+ */
+Test(async_io, file_offset)
+{
+    const size_t offset = DATA_SIZE - 4 * 65536;
+
+    for (size_t i = 0; i < sizeof(all_backends) / sizeof(*all_backends); ++i)
+    {
+        char *data = make_data();
+        FILE *in = tmpfile();
+        FILE *out = tmpfile();
+
+        cr_assert(in && out);
+        cr_assert_eq(fwrite(data, 1, DATA_SIZE, in), DATA_SIZE);
+        fflush(in);
+        cr_assert_eq(lseek(fileno(in), offset, SEEK_SET), (off_t)offset);
+
+        if (copy(fileno(in), fileno(out), all_backends[i]))
+        {
+            char *output = malloc(DATA_SIZE + 1);
+
+            cr_assert_not_null(output);
+            rewind(out);
+            cr_assert_eq(fread(output, 1, DATA_SIZE + 1, out),
+                         DATA_SIZE - offset, "backend %d", all_backends[i]);
+            cr_assert(memcmp(output, data + offset, DATA_SIZE - offset) == 0);
+            free(output);
+        }
+
+        fclose(out);
+        fclose(in);
+        free(data);
+    }
+}
+
+/*
+ * The descriptors are shared with the other processes of the pipeline, their
+ * flags must be left alone.
+ */
+Test(async_io, shared_flags)
+{
+    int fds[2];
+
+    cr_assert_eq(pipe(fds), 0);
+    for (size_t i = 0; i < sizeof(all_backends) / sizeof(*all_backends); ++i)
+    {
+        struct async_io *io = make_async_io(fds[0], fds[1], all_backends[i]);
+
+        if (io == NULL)
+            continue;
+        cr_expect_not(fcntl(fds[0], F_GETFL) & O_NONBLOCK, "%d", i);
+        cr_expect_not(fcntl(fds[1], F_GETFL) & O_NONBLOCK, "%d", i);
+        cr_assert(destroy_async_io(io));
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+Test(async_io, empty_input)
+{
+    for (size_t i = 0; i < sizeof(all_backends) / sizeof(*all_backends); ++i)
+    {
+        int in[2];
+
+        cr_assert_eq(pipe(in), 0);
+        close(in[1]);
+
+        struct async_io *io =
+            make_async_io(in[0], STDOUT_FILENO, all_backends[i]);
+        size_t len = 0;
+
+        if (io != NULL)
+        {
+            cr_assert_null(async_read(io, &len));
+            cr_assert_null(async_read(io, &len));
+            cr_assert(destroy_async_io(io));
+        }
+        close(in[0]);
+    }
+}
+
+/*
+ * A terminal goes on after the end of input, e.g: after ^D: nothing is read
+ * past it, the next lines are left to the next reader.
+ */
+Test(async_io, terminal_input)
+{
+    for (size_t i = 0; i < sizeof(all_backends) / sizeof(*all_backends); ++i)
+    {
+        int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+        cr_assert_geq(master, 0);
+        cr_assert_eq(grantpt(master), 0);
+        cr_assert_eq(unlockpt(master), 0);
+
+        int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+        int out = open("/dev/null", O_WRONLY);
+        char data[16];
+        size_t len = 0;
+
+        cr_assert_geq(slave, 0);
+        cr_assert_geq(out, 0);
+        cr_assert_eq(write(master, "1 + 1\n\x04", 7), 7);
+
+        struct async_io *io = make_async_io(slave, out, all_backends[i]);
+        if (io != NULL)
+        {
+            const char *line = async_read(io, &len);
+
+            cr_assert_not_null(line, "%zu", i);
+            cr_expect_eq(len, 6, "%zu", i);
+            cr_assert_null(async_read(io, &len), "%zu", i);
+
+            cr_assert_eq(write(master, "2 + 2\n", 6), 6);
+            cr_assert(destroy_async_io(io), "%zu", i);
+
+            struct pollfd pfd = { slave, POLLIN, 0 };
+            cr_assert_eq(poll(&pfd, 1, 1000), 1, "%zu", i);
+            cr_expect_eq(read(slave, data, sizeof(data)), 6, "%zu", i);
+        }
+
+        close(out);
+        close(slave);
+        close(master);
+    }
+}
+
+Test(async_io, write_error)
+{
+    for (size_t i = 0; i < sizeof(all_backends) / sizeof(*all_backends); ++i)
+    {
+        int out[2];
+
+        cr_assert_eq(pipe(out), 0);
+        close(out[0]);
+
+        struct async_io *io =
+            make_async_io(STDIN_FILENO, out[1], all_backends[i]);
+
+        if (io != NULL)
+        {
+            async_write(io, "42\n", 3);
+            cr_assert_not(destroy_async_io(io));
+        }
+        close(out[1]);
+    }
+}
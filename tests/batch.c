@@ -0,0 +1,439 @@
+#include <criterion/criterion.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ast/ast.h"
+#include "eval/eval.h"
+#include "io/columns.h"
+#include "opt/opt.h"
+#include "parse/parse.h"
+
+static const char *const names[] = { "x", "y", "long_name_2" };
+
+TestSuite(batch);
+
+static void do_success(const char *input, const int *vals, int expected)
+{
+    struct ast_node *ast = recursive_parse_vars(input, names, 3);
+    const int *vars[] = { &vals[0], &vals[1], &vals[2] };
+    int res = 0;
+
+    cr_assert_not_null(ast, "%s", input);
+
+    struct batch_eval *batch = make_batch_eval(ast, false);
+    cr_assert_not_null(batch);
+    cr_assert(batch_eval(batch, vars, 1, &res));
+    cr_expect_eq(res, expected, "%s", input);
+
+    destroy_batch_eval(batch);
+    destroy_ast(ast);
+}
+
+static void do_failure(const char *input)
+{
+    struct ast_node *ast = recursive_parse_vars(input, names, 3);
+
+    cr_expect_null(ast, "%s", input);
+
+    destroy_ast(ast); // Do not leak if it exists
+}
+
+Test(batch, variables)
+{
+    static const int vals[] = { 3, -4, 5 };
+
+    do_success("x", vals, 3);
+    do_success("y", vals, -4);
+    do_success("long_name_2", vals, 5);
+    do_success("x * y + long_name_2", vals, -7);
+    do_success("-x^2", vals, -9);
+    do_success("(x + 1)!", vals, 24);
+    do_success("  x+x*x  ", vals, 12);
+    do_success("long_name_2 / x - y", vals, 5);
+}
+
+Test(batch, unknown_variables)
+{
+    do_failure("z");
+    do_failure("xy");
+    do_failure("long_name");
+    do_failure("x y");
+    do_failure("2x");
+    do_failure("x + _");
+}
+
+Test(batch, no_variables)
+{
+    struct ast_node *ast = recursive_parse("x + 1");
+
+    cr_expect_null(ast);
+    destroy_ast(ast);
+}
+
+/*
+ * Compare with the evaluation of the same formula, the values of the
+ * variables being written out as numbers. Rows span several blocks.
+ */
+Test(batch, same_as_eval)
+{
+    static const char *const formulas[] = {
+        "x + y * long_name_2",
+        "(x - y) / 7 + y ^ 3",
+        "-x * 5 - +y! / (long_name_2 + 100)",
+        "x / -3 + x / 1 + x / 17 + 42",
+        "((x))",
+        "12 * 3",
+    };
+    enum { NB_ROWS = 5000 };
+    static int columns[3][NB_ROWS];
+    static int res[NB_ROWS];
+    const int *vars[] = { columns[0], columns[1], columns[2] };
+
+    for (size_t i = 0; i < NB_ROWS; ++i)
+    {
+        columns[0][i] = (int)(i * 7919 % 2001) - 1000;
+        columns[1][i] = i % 13;
+        columns[2][i] = (int)(i * 31 % 97);
+    }
+
+    for (size_t f = 0; f < sizeof(formulas) / sizeof(*formulas); ++f)
+    {
+        struct ast_node *ast =
+            specialize_ast(recursive_parse_vars(formulas[f], names, 3));
+        struct batch_eval *batch = make_batch_eval(ast, false);
+
+        cr_assert_not_null(batch, "%s", formulas[f]);
+        destroy_ast(ast);
+        cr_assert(batch_eval(batch, vars, NB_ROWS, res));
+
+        for (size_t i = 0; i < NB_ROWS; ++i)
+        {
+            char input[256];
+            char *it = input;
+
+            // Substitute each variable with its value, in parenthesis
+            for (const char *c = formulas[f]; *c;)
+            {
+                size_t var = 3;
+                for (size_t v = 0; v < 3; ++v)
+                    if (strncmp(c, names[v], strlen(names[v])) == 0
+                        && (var == 3 || strlen(names[v]) > strlen(names[var])))
+                        var = v;
+
+                if (var == 3)
+                {
+                    *it++ = *c++;
+                    continue;
+                }
+
+                it += sprintf(it, "(%d)", columns[var][i]);
+                c += strlen(names[var]);
+            }
+            *it = '\0';
+
+            struct ast_node *expected = recursive_parse(input);
+            cr_assert_not_null(expected, "%s", input);
+            cr_assert_eq(res[i], eval_ast(expected), "%s", input);
+            destroy_ast(expected);
+        }
+
+        destroy_batch_eval(batch);
+    }
+}
+
+/*
+ * Programs give the same results as the formula with their bindings written
+ * out in full.
+ */
+Test(batch, programs)
+{
+    static const char *const programs[][2] = {
+        { "t = x * y; u = t ^ 2 + t; u - t!",
+          "(x * y) ^ 2 + (x * y) - (x * y)!" },
+        { "  a=x ;b = a+1;c=b*2 ; c - a", "(x + 1) * 2 - x" },
+        { "t = 3; t * long_name_2", "3 * long_name_2" },
+        { "t = x; t", "x" },
+        { "unused = y / 7; x + y", "x + y" },
+    };
+    enum { NB_ROWS = 3000 };
+    static int columns[3][NB_ROWS];
+    static int expected[NB_ROWS];
+    static int res[NB_ROWS];
+    const int *vars[] = { columns[0], columns[1], columns[2] };
+
+    for (size_t i = 0; i < NB_ROWS; ++i)
+    {
+        columns[0][i] = (int)(i * 7919 % 201) - 100;
+        columns[1][i] = i % 13;
+        columns[2][i] = (int)(i * 31 % 97);
+    }
+
+    for (size_t p = 0; p < sizeof(programs) / sizeof(*programs); ++p)
+    {
+        struct ast_node *program =
+            specialize_ast(recursive_parse_vars(programs[p][0], names, 3));
+        struct ast_node *formula =
+            specialize_ast(recursive_parse_vars(programs[p][1], names, 3));
+
+        cr_assert_not_null(program, "%s", programs[p][0]);
+        cr_assert_not_null(formula, "%s", programs[p][1]);
+
+        struct batch_eval *batch = make_batch_eval(program, false);
+        cr_assert(batch_eval(batch, vars, NB_ROWS, res));
+        destroy_batch_eval(batch);
+
+        batch = make_batch_eval(formula, false);
+        cr_assert(batch_eval(batch, vars, NB_ROWS, expected));
+        destroy_batch_eval(batch);
+
+        for (size_t i = 0; i < NB_ROWS; ++i)
+            cr_assert_eq(res[i], expected[i], "%s, row %zu", programs[p][0],
+                         i);
+
+        destroy_ast(program);
+        destroy_ast(formula);
+    }
+}
+
+Test(batch, invalid_programs)
+{
+    do_failure("t = 1; t = 2; t"); // Bound twice
+    do_failure("x = 1; x"); // Shadows a column
+    do_failure("t = u; u = 1; t"); // Used before being bound
+    do_failure("t = 1;");
+    do_failure("t = 1 t");
+    do_failure("t = 1; t;");
+    do_failure("t = ; 1");
+    do_failure("t == 1; t");
+    do_failure("= 1; 2");
+    do_failure("; 1");
+    do_failure("1; 2");
+    do_failure("2t = 1; 2");
+
+    // Only formulas can be programs
+    struct ast_node *ast = recursive_parse("t = 1; t");
+    cr_expect_null(ast);
+    destroy_ast(ast);
+}
+
+static bool eval_checked(const char *input, int x)
+{
+    struct ast_node *ast = recursive_parse_vars(input, names, 1);
+    const int *vars[] = { &x };
+    int res = 0;
+
+    cr_assert_not_null(ast, "%s", input);
+
+    struct batch_eval *batch = make_batch_eval(ast, true);
+    bool ret = batch_eval(batch, vars, 1, &res);
+
+    destroy_batch_eval(batch);
+    destroy_ast(ast);
+
+    return ret;
+}
+
+/*
+ * Bindings which are not used, even through other bindings, are never
+ * evaluated: their errors are not reported.
+ */
+Test(batch, dead_bindings)
+{
+    cr_expect(eval_checked("d = x / 0; x + 1", 1));
+    cr_expect(eval_checked("d = x / 0; e = d + 1; x", 1));
+    cr_expect_not(eval_checked("d = x / 0; d + 1", 1));
+    cr_expect_not(eval_checked("d = x / 0; e = d + 1; e", 1));
+    cr_expect_not(eval_checked("t = x + 1; t", 2147483647));
+}
+
+Test(batch, csv_columns)
+{
+    static const char data[] = " a , bb\t,c\r\n1,2,3\n\n -4 ,+5,  6\r\n7,8,9";
+    FILE *in = fmemopen((void *)data, sizeof(data) - 1, "r");
+    struct column_reader *reader = make_column_reader(in, COLUMNS_CSV, NULL);
+    int values[3][2];
+    int *columns[] = { values[0], values[1], values[2] };
+
+    cr_assert_not_null(reader);
+    cr_assert_eq(column_count(reader), 3);
+    cr_expect_str_eq(column_names(reader)[0], "a");
+    cr_expect_str_eq(column_names(reader)[1], "bb");
+    cr_expect_str_eq(column_names(reader)[2], "c");
+
+    cr_assert_eq(read_columns(reader, columns, 2), 2);
+    cr_expect_eq(values[0][0], 1);
+    cr_expect_eq(values[2][0], 3);
+    cr_expect_eq(values[0][1], -4);
+    cr_expect_eq(values[1][1], 5);
+    cr_assert_eq(read_columns(reader, columns, 2), 1);
+    cr_expect_eq(values[1][0], 8);
+    cr_assert_eq(read_columns(reader, columns, 2), 0);
+
+    cr_expect(destroy_column_reader(reader));
+    fclose(in);
+}
+
+Test(batch, csv_errors)
+{
+    static const char *const inputs[] = {
+        "\n",
+        "a,,b\n1,2,3\n",
+        "a,b\n1,2,3\n",
+        "a,b\n1\n",
+        "a,b\n1,x\n",
+        "a,b\n1,2147483648\n",
+        "a,b\n1,-2147483649\n",
+        "a,b\n1,-\n",
+    };
+
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(*inputs); ++i)
+    {
+        FILE *in = fmemopen((void *)inputs[i], strlen(inputs[i]), "r");
+        struct column_reader *reader =
+            make_column_reader(in, COLUMNS_CSV, NULL);
+        int values[3][4];
+        int *columns[] = { values[0], values[1], values[2] };
+
+        if (reader)
+        {
+            cr_expect_eq(read_columns(reader, columns, 4), 0, "%zu", i);
+            cr_expect_not(destroy_column_reader(reader), "%zu", i);
+        }
+        fclose(in);
+    }
+}
+
+Test(batch, duplicate_columns)
+{
+    static const char *const inputs[] = {
+        "x,x\n1,2\n",
+        "x, y ,\ty\n1,2,3\n",
+        "x,y,z,x\n1,2,3,4\n",
+    };
+
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(*inputs); ++i)
+    {
+        FILE *in = fmemopen((void *)inputs[i], strlen(inputs[i]), "r");
+        const char *error = NULL;
+
+        cr_expect_null(make_column_reader(in, COLUMNS_CSV, &error), "%zu", i);
+        cr_expect_str_eq(error, "Duplicate column name", "%zu", i);
+        fclose(in);
+    }
+
+    // Names sharing a prefix are different
+    static const char data[] = "x,xy,y\n1,2,3\n";
+    FILE *in = fmemopen((void *)data, sizeof(data) - 1, "r");
+    struct column_reader *reader = make_column_reader(in, COLUMNS_CSV, NULL);
+
+    cr_assert_not_null(reader);
+    cr_expect_eq(column_count(reader), 3);
+    destroy_column_reader(reader);
+    fclose(in);
+}
+
+Test(batch, binary_columns)
+{
+    char data[256];
+    size_t len = sprintf(data, "x,y\n");
+    // Blocks of 3, 0, and 2 rows
+    const int32_t blocks[][7] = {
+        { 3, 1, 2, 3, -1, -2, -3 },
+        { 0 },
+        { 2, 10, 20, 30, 40 },
+    };
+    const size_t sizes[] = { 7, 1, 5 };
+
+    for (size_t i = 0; i < 3; ++i)
+    {
+        for (size_t j = 0; j < sizes[i]; ++j)
+        {
+            uint32_t val = blocks[i][j];
+            memcpy(data + len, &val, sizeof(val));
+            len += sizeof(val);
+        }
+    }
+
+    FILE *in = fmemopen(data, len, "r");
+    struct column_reader *reader = make_column_reader(in, COLUMNS_BINARY, NULL);
+    int values[2][2];
+    int *columns[] = { values[0], values[1] };
+
+    cr_assert_not_null(reader);
+    cr_assert_eq(column_count(reader), 2);
+
+    // Blocks bigger than asked for are returned in several parts
+    cr_assert_eq(read_columns(reader, columns, 2), 2);
+    cr_expect_eq(values[0][1], 2);
+    cr_expect_eq(values[1][1], -2);
+    cr_assert_eq(read_columns(reader, columns, 2), 1);
+    cr_expect_eq(values[0][0], 3);
+    cr_expect_eq(values[1][0], -3);
+    cr_assert_eq(read_columns(reader, columns, 2), 2);
+    cr_expect_eq(values[0][0], 10);
+    cr_expect_eq(values[1][1], 40);
+    cr_assert_eq(read_columns(reader, columns, 2), 0);
+    cr_expect(destroy_column_reader(reader));
+
+    fclose(in);
+
+    // Truncated block
+    in = fmemopen(data, len - 1, "r");
+    reader = make_column_reader(in, COLUMNS_BINARY, NULL);
+    cr_assert_not_null(reader);
+    while (read_columns(reader, columns, 2) > 0)
+        continue;
+    cr_expect_not(destroy_column_reader(reader));
+    fclose(in);
+}
+
+Test(batch, write_columns)
+{
+    static const int vals[] = { 0, -1, 42, -2147483647 - 1, 2147483647 };
+    char *data = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&data, &len);
+
+    cr_assert_not_null(out);
+    cr_assert(write_column_header(out, COLUMNS_CSV, "result"));
+    cr_assert(write_column(out, COLUMNS_CSV, vals, 5));
+    fclose(out);
+
+    cr_expect_str_eq(data,
+                     "result\n0\n-1\n42\n-2147483648\n2147483647\n");
+    free(data);
+}
+
+Test(batch, round_trip)
+{
+    static const int vals[] = { 0, -1, 42, -2147483647 - 1, 2147483647 };
+    static const enum column_format formats[] = { COLUMNS_CSV, COLUMNS_BINARY };
+
+    for (size_t f = 0; f < 2; ++f)
+    {
+        char *data = NULL;
+        size_t len = 0;
+        FILE *out = open_memstream(&data, &len);
+
+        cr_assert_not_null(out);
+        cr_assert(write_column_header(out, formats[f], "result"));
+        cr_assert(write_column(out, formats[f], vals, 5));
+        fclose(out);
+
+        FILE *in = fmemopen(data, len, "r");
+        struct column_reader *reader = make_column_reader(in, formats[f], NULL);
+        int res[5];
+        int *columns[] = { res };
+
+        cr_assert_not_null(reader);
+        cr_assert_eq(read_columns(reader, columns, 5), 5, "format %zu", f);
+        for (size_t i = 0; i < 5; ++i)
+            cr_expect_eq(res[i], vals[i], "format %zu, row %zu", f, i);
+        cr_expect(destroy_column_reader(reader));
+
+        fclose(in);
+        free(data);
+    }
+}
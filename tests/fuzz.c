@@ -0,0 +1,1052 @@
+#include <errno.h>
+#include <limits.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ast/ast.h"
+#include "eval/eval.h"
+#include "opt/opt.h"
+#include "parse/parse.h"
+#include "parse/scan.h"
+
+/*
+ * Differential fuzzer for both parsers and the evaluator.
+ *
+ * Every input is parsed by all parsers, which must agree on whether the input
+ * is valid and on the shape of the resulting tree.
+ * Valid trees are then evaluated by `eval_ast`, before and after going through
+ * `specialize_ast`, and compared to a reference evaluator using wrapping
+ * arithmetic, skipping inputs which would trap.
+ *
+ * Inputs whose parsing time or allocated memory per input byte goes above the
+ * configured thresholds are reported as well. Every reported input is
+ * minimized and saved to the corpus directory, once per shape, see
+ * `shape_hash`. The directory is outside of the tree by default: findings
+ * worth keeping as benchmarks are copied to `bench/corpus` by hand. Inputs
+ * saved previously can be checked again, see `replay`.
+ *
+ * Build with `make fuzz`, or with `-DFUZZ_LIBFUZZER` and `-fsanitize=fuzzer`
+ * to use the same checks as a libFuzzer target.
+ */
+
+#define ARR_SIZE(Arr) (sizeof(Arr) / sizeof(*Arr))
+
+// Do not try to run evaluations which would be too slow, e.g: `99999999!`
+#define EVAL_MAX_COST 10000000ul
+// Per byte measurements are meaningless on small inputs
+#define RATIO_MIN_LEN 1024
+
+enum issue
+{
+    ISSUE_NONE,
+    ISSUE_MISMATCH, // Parsers disagree on the input
+    ISSUE_EVAL, // Evaluation does not match the reference
+    ISSUE_TIME, // Parsing time per byte is above threshold
+    ISSUE_MEMORY, // Allocated memory per byte is above threshold
+    ISSUE_EVAL_COST, // Evaluation cost per byte is above threshold
+};
+
+static struct
+{
+    unsigned long iterations;
+    unsigned long seed;
+    size_t max_len;
+    double ns_per_byte;
+    double mem_per_byte;
+    double cost_per_byte;
+    const char *corpus;
+    unsigned long max_saved;
+    bool verbose;
+} opts = {
+    .iterations = 10000,
+    .seed = 42,
+    .max_len = 1 << 16,
+    .ns_per_byte = 500.,
+    .mem_per_byte = 128.,
+    .cost_per_byte = 1000.,
+    .corpus = "/tmp/evalexpr-corpus",
+    .max_saved = 16,
+    .verbose = false,
+};
+
+/*
+ * Allocation accounting, enabled by linking with `-Wl,--wrap=<function>`.
+ */
+
+static size_t live_bytes;
+static size_t peak_bytes;
+
+#ifndef FUZZ_LIBFUZZER
+
+void *__real_malloc(size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static void account(size_t added, size_t removed)
+{
+    live_bytes += added;
+    live_bytes -= removed;
+    if (live_bytes > peak_bytes)
+        peak_bytes = live_bytes;
+}
+
+void *__wrap_malloc(size_t size)
+{
+    void *ret = __real_malloc(size);
+    if (ret)
+        account(malloc_usable_size(ret), 0);
+    return ret;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    size_t old = ptr ? malloc_usable_size(ptr) : 0;
+    void *ret = __real_realloc(ptr, size);
+    if (ret)
+        account(malloc_usable_size(ret), old);
+    return ret;
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr)
+        account(0, malloc_usable_size(ptr));
+    __real_free(ptr);
+}
+
+#endif /* !FUZZ_LIBFUZZER */
+
+/*
+ * Reference evaluation, using unsigned arithmetic to avoid undefined behaviour
+ */
+
+static bool ast_equal(const struct ast_node *lhs, const struct ast_node *rhs)
+{
+    if (!lhs || !rhs)
+        return lhs == rhs;
+    if (lhs->kind != rhs->kind || lhs->size != rhs->size)
+        return false;
+
+    switch (lhs->kind)
+    {
+    case NODE_NUM:
+        return lhs->val.num == rhs->val.num;
+    case NODE_VAR:
+        return lhs->val.var == rhs->val.var;
+    case NODE_UNOP:
+        return lhs->val.un_op.op == rhs->val.un_op.op
+            && ast_equal(lhs->val.un_op.tree, rhs->val.un_op.tree);
+    case NODE_BINOP:
+        return lhs->val.bin_op.op == rhs->val.bin_op.op
+            && ast_equal(lhs->val.bin_op.lhs, rhs->val.bin_op.lhs)
+            && ast_equal(lhs->val.bin_op.rhs, rhs->val.bin_op.rhs);
+    case NODE_CONSTOP:
+        return lhs->val.const_op.op == rhs->val.const_op.op
+            && lhs->val.const_op.val == rhs->val.const_op.val
+            && ast_equal(lhs->val.const_op.tree, rhs->val.const_op.tree);
+    case NODE_LET:
+        return lhs->val.let.var == rhs->val.let.var
+            && ast_equal(lhs->val.let.value, rhs->val.let.value)
+            && ast_equal(lhs->val.let.body, rhs->val.let.body);
+    }
+
+    return false;
+}
+
+static unsigned ref_pow(unsigned lhs, int rhs, unsigned long *cost)
+{
+    // Same exponentiation by squaring as the evaluator, negatives included
+    unsigned ret = 1;
+    while (rhs)
+    {
+        if (rhs & 1)
+            ret *= lhs;
+        lhs *= lhs;
+        rhs /= 2;
+        *cost += 1;
+    }
+    return ret;
+}
+
+static unsigned ref_fact(int num, unsigned long *cost)
+{
+    unsigned ret = 1;
+    if (num > 1)
+        *cost += num;
+    // Every factorial above 34 is a multiple of 2^32
+    if (num > 34)
+        return 0;
+    while (num > 1)
+        ret *= num--;
+    return ret;
+}
+
+/*
+ * Return false if the evaluation would trap, i.e: divisions by zero or of
+ * `INT_MIN` by -1.
+ */
+static bool ref_eval(const struct ast_node *ast, int *res, unsigned long *cost)
+{
+    int lhs;
+    int rhs;
+
+    *cost += 1;
+    switch (ast->kind)
+    {
+    case NODE_NUM:
+        *res = ast->val.num;
+        return true;
+    case NODE_UNOP:
+        if (!ast->val.un_op.tree || !ref_eval(ast->val.un_op.tree, &lhs, cost))
+            return false;
+        switch (ast->val.un_op.op)
+        {
+        case UNOP_IDENTITY:
+            *res = lhs;
+            return true;
+        case UNOP_NEGATE:
+            *res = -(unsigned)lhs;
+            return true;
+        case UNOP_FACT:
+            *res = ref_fact(lhs, cost);
+            return true;
+        default:
+            return false;
+        }
+    case NODE_BINOP:
+        if (!ast->val.bin_op.lhs || !ast->val.bin_op.rhs)
+            return false;
+        if (!ref_eval(ast->val.bin_op.lhs, &lhs, cost))
+            return false;
+        if (!ref_eval(ast->val.bin_op.rhs, &rhs, cost))
+            return false;
+        switch (ast->val.bin_op.op)
+        {
+        case BINOP_PLUS:
+            *res = (unsigned)lhs + (unsigned)rhs;
+            return true;
+        case BINOP_MINUS:
+            *res = (unsigned)lhs - (unsigned)rhs;
+            return true;
+        case BINOP_TIMES:
+            *res = (unsigned)lhs * (unsigned)rhs;
+            return true;
+        case BINOP_DIVIDES:
+            if (rhs == 0 || (lhs == INT_MIN && rhs == -1))
+                return false;
+            *res = lhs / rhs;
+            return true;
+        case BINOP_POW:
+            *res = ref_pow(lhs, rhs, cost);
+            return true;
+        default:
+            return false;
+        }
+    case NODE_CONSTOP:
+    case NODE_VAR:
+    case NODE_LET:
+        break; // Never built by the parsers under test
+    }
+
+    return false;
+}
+
+/*
+ * Checks
+ */
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static struct ast_node *measure_parse(struct ast_node *(*parse)(const char *),
+                                      const char *input, double *ns,
+                                      size_t *mem)
+{
+    size_t live_before = live_bytes;
+    peak_bytes = live_bytes;
+
+    double start = now_ns();
+    struct ast_node *ast = parse(input);
+    *ns = now_ns() - start;
+    *mem = peak_bytes - live_before;
+
+    return ast;
+}
+
+/*
+ * Feed the input in chunks of varying sizes, to split numbers and operators
+ */
+static struct ast_node *stream_parse_chunked(const char *input)
+{
+    struct stream_parser *parser = make_stream_parser();
+    size_t len = strlen(input);
+    size_t chunk = 1;
+
+    for (size_t i = 0; i < len; i += chunk, chunk = chunk % 7 + 1)
+    {
+        size_t size = len - i < chunk ? len - i : chunk;
+        if (!stream_parse(parser, input + i, size))
+            break;
+    }
+
+    return finish_stream_parser(parser);
+}
+
+/*
+ * Split even the smallest inputs, to exercise the joins
+ */
+static struct ast_node *parallel_parse_split(const char *input)
+{
+    return parallel_parse(input, 4, 1);
+}
+
+static const struct
+{
+    const char *name;
+    struct ast_node *(*parse)(const char *input);
+    bool timed; // Starting threads costs more than parsing small inputs
+} parsers[] = {
+    { "climbing", climbing_parse, true },
+    { "recursive", recursive_parse, true },
+    { "stream", stream_parse_chunked, true },
+    { "parallel", parallel_parse_split, false },
+};
+
+/*
+ * Parsing time of the slowest parser, keeping the best of a few runs of each
+ * one: a single run is too noisy to be reported.
+ */
+static double confirm_parse_ns(const char *input)
+{
+    double ret = 0;
+
+    for (size_t i = 0; i < ARR_SIZE(parsers); ++i)
+    {
+        double best = 0;
+
+        for (int run = 0; parsers[i].timed && run < 3; ++run)
+        {
+            double ns;
+            size_t mem;
+            destroy_ast(measure_parse(parsers[i].parse, input, &ns, &mem));
+            if (run == 0 || ns < best)
+                best = ns;
+        }
+        if (best > ret)
+            ret = best;
+    }
+
+    return ret;
+}
+
+static enum issue check_input(const char *input)
+{
+    size_t len = strlen(input);
+    struct ast_node *asts[ARR_SIZE(parsers)];
+    double ns = 0;
+    size_t mem = 0;
+
+    for (size_t i = 0; i < ARR_SIZE(parsers); ++i)
+    {
+        double parse_ns;
+        size_t parse_mem;
+        asts[i] = measure_parse(parsers[i].parse, input, &parse_ns, &parse_mem);
+        if (parsers[i].timed && parse_ns > ns)
+            ns = parse_ns;
+        if (parse_mem > mem)
+            mem = parse_mem;
+    }
+
+    enum issue ret = ISSUE_NONE;
+    double bytes = len ? len : 1;
+
+    for (size_t i = 1; i < ARR_SIZE(parsers); ++i)
+        if (!ast_equal(asts[0], asts[i]))
+            ret = ISSUE_MISMATCH;
+
+    int expected;
+    unsigned long cost = 0;
+    if (ret != ISSUE_NONE || !asts[0])
+        ; // Nothing to evaluate
+    else if (!ref_eval(asts[0], &expected, &cost))
+        ; // Would trap, nothing to compare
+    else if (cost / bytes > opts.cost_per_byte || cost > EVAL_MAX_COST)
+        ret = ISSUE_EVAL_COST;
+    else
+    {
+        for (size_t i = 0; i < ARR_SIZE(parsers); ++i)
+            if (eval_ast(asts[i]) != expected)
+                ret = ISSUE_EVAL;
+
+        // The specialized tree must give the exact same result
+        asts[0] = specialize_ast(asts[0]);
+        if (eval_ast(asts[0]) != expected)
+            ret = ISSUE_EVAL;
+    }
+
+    if (ret == ISSUE_NONE)
+    {
+        if (len < RATIO_MIN_LEN)
+            ; // Fixed costs dominate the measurements
+        else if (mem / bytes > opts.mem_per_byte)
+            ret = ISSUE_MEMORY;
+        else if (ns / bytes > opts.ns_per_byte
+                 && confirm_parse_ns(input) / bytes > opts.ns_per_byte)
+            ret = ISSUE_TIME;
+    }
+
+    for (size_t i = 0; i < ARR_SIZE(parsers); ++i)
+        destroy_ast(asts[i]);
+
+    return ret;
+}
+
+#ifdef FUZZ_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    char *input = malloc(size + 1);
+    if (!input)
+        return 0;
+    memcpy(input, data, size);
+    input[size] = '\0';
+
+    // Let libFuzzer report the crash along with its own reproducer
+    enum issue issue = check_input(input);
+    if (issue == ISSUE_MISMATCH || issue == ISSUE_EVAL)
+        abort();
+
+    free(input);
+    return 0;
+}
+
+#else /* !FUZZ_LIBFUZZER */
+
+static const char *issue_names[] = {
+    [ISSUE_NONE] = "none",
+    [ISSUE_MISMATCH] = "mismatch",
+    [ISSUE_EVAL] = "eval",
+    [ISSUE_TIME] = "time",
+    [ISSUE_MEMORY] = "memory",
+    [ISSUE_EVAL_COST] = "eval-cost",
+};
+
+// Findings of each kind, and the ones with a new shape
+static unsigned long issue_count[ARR_SIZE(issue_names)];
+static unsigned long saved_count[ARR_SIZE(issue_names)];
+
+/*
+ * Input generation
+ */
+
+struct buffer
+{
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+static unsigned long rng_state;
+
+static unsigned long rng(void)
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (rng_state * 2685821657736338717ull) >> 11;
+}
+
+static unsigned long rng_below(unsigned long max)
+{
+    return max ? rng() % max : 0;
+}
+
+static void buf_putc(struct buffer *buf, char c)
+{
+    if (buf->len + 1 >= buf->cap)
+    {
+        buf->cap = buf->cap ? buf->cap * 2 : 64;
+        buf->data = realloc(buf->data, buf->cap);
+        if (!buf->data)
+            abort();
+    }
+    buf->data[buf->len++] = c;
+    buf->data[buf->len] = '\0';
+}
+
+static void buf_puts(struct buffer *buf, const char *str)
+{
+    while (*str)
+        buf_putc(buf, *str++);
+}
+
+static void gen_space(struct buffer *buf)
+{
+    static const char spaces[] = " \t\v\f\r";
+    // Sometimes long enough to span multiple blocks of the scanning kernels
+    unsigned long len = rng_below(32) == 0 ? rng_below(100) : 0;
+    for (unsigned long i = 0; i < len || rng_below(4) == 0; ++i)
+        buf_putc(buf, spaces[rng_below(sizeof(spaces) - 1)]);
+}
+
+static void gen_number(struct buffer *buf)
+{
+    char num[16];
+    // Mostly small numbers, to keep the evaluation interesting
+    switch (rng_below(8))
+    {
+    case 0:
+        sprintf(num, "%lu", rng_below(INT_MAX));
+        break;
+    case 1:
+        sprintf(num, "0%lu", rng_below(100));
+        break;
+    case 2: // Around the largest literal
+        sprintf(num, "%lu", INT_MAX - 8 + rng_below(16));
+        break;
+    case 3:
+        sprintf(num, "%015lu", rng_below(INT_MAX));
+        break;
+    default:
+        sprintf(num, "%lu", rng_below(10));
+        break;
+    }
+    buf_puts(buf, num);
+}
+
+static void gen_expr(struct buffer *buf, int depth)
+{
+    static const char binops[] = "+-*/^";
+    static const char preops[] = "+-";
+
+    gen_space(buf);
+    if (depth <= 0 || buf->len > opts.max_len)
+    {
+        gen_number(buf);
+        gen_space(buf);
+        return;
+    }
+
+    switch (rng_below(6))
+    {
+    case 0:
+        buf_putc(buf, preops[rng_below(sizeof(preops) - 1)]);
+        gen_expr(buf, depth - 1);
+        break;
+    case 1:
+        buf_putc(buf, '(');
+        gen_expr(buf, depth - 1);
+        buf_putc(buf, ')');
+        break;
+    case 2:
+        gen_expr(buf, depth - 1);
+        buf_putc(buf, '!');
+        break;
+    default:
+        gen_expr(buf, depth - 1);
+        buf_putc(buf, binops[rng_below(sizeof(binops) - 1)]);
+        gen_expr(buf, depth - 1);
+        break;
+    }
+    gen_space(buf);
+}
+
+/*
+ * Mutate a valid expression, to exercise the error paths.
+ */
+static void mutate(struct buffer *buf)
+{
+    static const char alphabet[] = "0123456789+-*/^!() \t";
+    unsigned long count = 1 + rng_below(4);
+
+    while (count-- && buf->len)
+    {
+        size_t pos = rng_below(buf->len);
+        switch (rng_below(3))
+        {
+        case 0: // Replace
+            buf->data[pos] = alphabet[rng_below(sizeof(alphabet) - 1)];
+            break;
+        case 1: // Delete
+            memmove(buf->data + pos, buf->data + pos + 1, buf->len - pos);
+            buf->len -= 1;
+            break;
+        case 2: // Duplicate
+            buf_putc(buf, '\0');
+            memmove(buf->data + pos + 1, buf->data + pos, buf->len - pos - 1);
+            break;
+        }
+    }
+}
+
+/*
+ * Shapes which are known to stress recursion or repeated scanning, growing
+ * up to the maximum input length.
+ */
+static void gen_pathological(struct buffer *buf)
+{
+    static const char *patterns[][3] = {
+        // Prefix, repeated part, suffix
+        { "", "(", "1" }, // Closing parentheses are added below
+        { "", "-", "1" },
+        { "1", "+1", "" },
+        { "2", "^2", "" },
+        { "1", " * 1", "" },
+        { "1", "                +1", "" },
+        { "", "+-", "1" },
+    };
+    size_t pattern = rng_below(ARR_SIZE(patterns));
+    size_t count = 1 + rng_below(opts.max_len / 4);
+
+    buf_puts(buf, patterns[pattern][0]);
+    for (size_t i = 0; i < count; ++i)
+        buf_puts(buf, patterns[pattern][1]);
+    buf_puts(buf, patterns[pattern][2]);
+    if (pattern == 0)
+        for (size_t i = 0; i < count; ++i)
+            buf_putc(buf, ')');
+}
+
+/*
+ * Minimization and corpus
+ */
+
+// Slow parses are large and each check is expensive
+static bool coarse_issue(enum issue issue)
+{
+    return issue == ISSUE_TIME || issue == ISSUE_MEMORY;
+}
+
+/*
+ * Replace the input with the candidate if the reported issue stays the same
+ */
+static bool keep(struct buffer *buf, const char *candidate, enum issue issue)
+{
+    if (check_input(candidate) != issue)
+        return false;
+
+    buf->len = strlen(candidate);
+    memcpy(buf->data, candidate, buf->len + 1);
+    return true;
+}
+
+/*
+ * Remove chunks of decreasing size from the input, down to single characters
+ * or, for coarse issues, to a 64th of the input. Chunks of up to 4 bytes are
+ * tried with every size and at every offset, e.g: to remove the `*0` of
+ * `123!*0`.
+ */
+static bool remove_chunks(struct buffer *buf, char *candidate,
+                          enum issue issue)
+{
+    size_t len = buf->len;
+    size_t min_chunk = coarse_issue(issue) ? buf->len / 64 + 1 : 1;
+
+    for (size_t chunk = buf->len / 2; chunk >= min_chunk;
+         chunk = chunk > 4 ? chunk / 2 : chunk - 1)
+    {
+        size_t step = chunk <= 4 ? 1 : chunk;
+        size_t pos = 0;
+        while (pos + chunk <= buf->len)
+        {
+            memcpy(candidate, buf->data, pos);
+            memcpy(candidate + pos, buf->data + pos + chunk,
+                   buf->len - pos - chunk + 1);
+
+            if (!keep(buf, candidate, issue))
+                pos += step;
+        }
+    }
+
+    return buf->len != len;
+}
+
+/*
+ * Remove pairs of matching parentheses, which chunks only do when the pair
+ * is empty.
+ */
+static bool remove_parens(struct buffer *buf, char *candidate,
+                          enum issue issue)
+{
+    bool changed = false;
+
+    for (size_t open = 0; open < buf->len; ++open)
+    {
+        size_t close = open + 1;
+        size_t depth = 1;
+
+        if (buf->data[open] != '(')
+            continue;
+        for (; close < buf->len; ++close)
+        {
+            depth += buf->data[close] == '(';
+            depth -= buf->data[close] == ')';
+            if (depth == 0)
+                break;
+        }
+        if (depth != 0)
+            continue;
+
+        size_t len = 0;
+        for (size_t i = 0; i <= buf->len; ++i)
+            if (i != open && i != close)
+                candidate[len++] = buf->data[i];
+
+        // The next pair may start at the same position
+        if (keep(buf, candidate, issue))
+        {
+            changed = true;
+            open -= 1;
+        }
+    }
+
+    return changed;
+}
+
+/*
+ * Replace the `*len` digits at `pos` by `num`, which is not longer
+ */
+static bool replace_number(struct buffer *buf, char *candidate, size_t pos,
+                           size_t *len, unsigned long num, enum issue issue)
+{
+    size_t num_len = sprintf(candidate + pos, "%lu", num);
+
+    memcpy(candidate, buf->data, pos);
+    memcpy(candidate + pos + num_len, buf->data + pos + *len,
+           buf->len - pos - *len + 1);
+
+    if (!keep(buf, candidate, issue))
+        return false;
+
+    *len = num_len;
+    return true;
+}
+
+/*
+ * Replace numbers by 0, 1 or 2, or else by halves of them, as small as the
+ * issue allows, dropping their leading zeros.
+ */
+static bool shrink_numbers(struct buffer *buf, char *candidate,
+                           enum issue issue)
+{
+    bool changed = false;
+
+    for (size_t pos = 0; pos < buf->len; ++pos)
+    {
+        if (!is_digit(buf->data[pos]) || (pos && is_digit(buf->data[pos - 1])))
+            continue;
+
+        size_t len = 1;
+        while (is_digit(buf->data[pos + len]))
+            len += 1;
+
+        // Saturated on overflow, never longer than the digits it comes from
+        unsigned long num = strtoul(buf->data + pos, NULL, 10);
+        unsigned long smallest = num;
+
+        for (unsigned long small = 0; small <= 2 && small < smallest; ++small)
+            if (replace_number(buf, candidate, pos, &len, small, issue))
+                smallest = small;
+        while (smallest > 2
+               && replace_number(buf, candidate, pos, &len, smallest / 2,
+                                 issue))
+            smallest /= 2;
+
+        if (smallest == num && len > 1 && buf->data[pos] == '0')
+            changed |= replace_number(buf, candidate, pos, &len, num, issue);
+        changed |= smallest != num;
+    }
+
+    return changed;
+}
+
+/*
+ * Remove chunks of the input, then redundant parentheses, and shrink its
+ * numbers, as long as the reported issue stays the same. Coarse issues are
+ * only trimmed in chunks, instead of going down to single characters.
+ */
+static void minimize(struct buffer *buf, enum issue issue)
+{
+    char *candidate = malloc(buf->len + 1);
+    bool changed = true;
+
+    if (!candidate)
+        return;
+
+    // Until nothing changes, a change may let smaller chunks be removed
+    while (changed)
+    {
+        changed = remove_chunks(buf, candidate, issue);
+        if (coarse_issue(issue))
+            break;
+        changed |= remove_parens(buf, candidate, issue);
+        changed |= shrink_numbers(buf, candidate, issue);
+    }
+
+    free(candidate);
+}
+
+/*
+ * Hash of the shape of a minimized input, findings with the same one are only
+ * saved once. Numbers and whitespace do not matter. Coarse issues are only
+ * described by which pairs of symbols follow each other, as their inputs
+ * repeat a pattern, e.g: `((1))` and `(((12)))` have the same shape.
+ */
+static unsigned long shape_hash(const struct buffer *buf, enum issue issue)
+{
+    static bool pairs[UCHAR_MAX + 1][UCHAR_MAX + 1];
+    unsigned long hash = 5381 + issue;
+    unsigned char prev = '\0';
+    bool blank = false;
+
+    memset(pairs, 0, sizeof(pairs));
+    for (size_t i = 0; i < buf->len; ++i)
+    {
+        unsigned char c = is_digit(buf->data[i]) ? '0' : buf->data[i];
+
+        if (is_space(c) || (c == '0' && prev == '0' && !blank))
+        {
+            blank |= is_space(c);
+            continue;
+        }
+
+        if (coarse_issue(issue))
+            pairs[prev][c] = prev != '\0'; // Wherever the pattern starts
+        else
+            hash = hash * 33 + c;
+        prev = c;
+        blank = false;
+    }
+
+    for (size_t i = 0; coarse_issue(issue) && i <= UCHAR_MAX; ++i)
+        for (size_t j = 0; j <= UCHAR_MAX; ++j)
+            if (pairs[i][j])
+                hash = (hash * 33 + i) * 33 + j;
+
+    return hash;
+}
+
+/*
+ * Returns false if an input of the same shape was saved already, by this run
+ * or a previous one.
+ */
+static bool save_input(const struct buffer *buf, enum issue issue)
+{
+    char path[PATH_MAX];
+
+    if (mkdir(opts.corpus, 0755) && errno != EEXIST)
+    {
+        perror(opts.corpus);
+        return false;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s-%016lx.txt", opts.corpus,
+             issue_names[issue], shape_hash(buf, issue));
+    if (access(path, F_OK) == 0)
+        return false;
+
+    FILE *f = fopen(path, "w");
+    if (!f)
+    {
+        perror(path);
+        return false;
+    }
+    fprintf(f, "%s\n", buf->data);
+    fclose(f);
+
+    return true;
+}
+
+/*
+ * Check the inputs saved in the given files again, the ones which still
+ * reproduce an issue being minimized and saved to the corpus directory.
+ */
+static bool replay(char *const *paths, size_t nb_paths)
+{
+    struct buffer buf = { 0 };
+    bool failed = false;
+
+    for (size_t i = 0; i < nb_paths; ++i)
+    {
+        FILE *f = fopen(paths[i], "r");
+        int c;
+
+        if (!f)
+        {
+            perror(paths[i]);
+            failed = true;
+            continue;
+        }
+
+        buf.len = 0;
+        buf_putc(&buf, '\0'); // Make sure the buffer is allocated
+        buf.len = 0;
+        while ((c = fgetc(f)) != EOF)
+            buf_putc(&buf, c);
+        fclose(f);
+
+        // Saved inputs end with a newline
+        if (buf.len > 0 && buf.data[buf.len - 1] == '\n')
+            buf.data[--buf.len] = '\0';
+
+        size_t len = buf.len;
+        enum issue issue = check_input(buf.data);
+        if (issue == ISSUE_NONE)
+        {
+            printf("%s: none\n", paths[i]);
+            continue;
+        }
+
+        minimize(&buf, issue);
+        printf("%s: %s, %zu -> %zu bytes '%.80s'%s\n", paths[i],
+               issue_names[issue], len, buf.len, buf.data,
+               buf.len > 80 ? "..." : "");
+        save_input(&buf, issue);
+        failed |= issue == ISSUE_MISMATCH || issue == ISSUE_EVAL;
+    }
+    free(buf.data);
+
+    return failed;
+}
+
+static void usage(FILE *out, const char *name)
+{
+    fprintf(out,
+            "Usage: %s [-n iterations] [-s seed] [-l max-length] [-t ns/byte]"
+            " [-m bytes/byte] [-c cost/byte] [-o corpus-dir] [-k max-saved]"
+            " [-v] [file...]\n"
+            "\n"
+            "Check generated inputs, or the given files again.\n"
+            "  -n  number of inputs to generate (%lu)\n"
+            "  -s  seed of the generator (%lu)\n"
+            "  -l  maximum length of the inputs (%zu)\n"
+            "  -t  parsing time per byte to report, in ns (%g)\n"
+            "  -m  allocated memory per byte to report (%g)\n"
+            "  -c  evaluation cost per byte to report (%g)\n"
+            "  -o  directory where findings are saved (%s)\n"
+            "  -k  findings of each kind saved, besides wrong results (%lu)\n"
+            "  -v  print every finding\n"
+            "  -h  print this help\n",
+            name, opts.iterations, opts.seed, opts.max_len, opts.ns_per_byte,
+            opts.mem_per_byte, opts.cost_per_byte, opts.corpus,
+            opts.max_saved);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:l:t:m:c:o:k:vh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            opts.iterations = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            opts.seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            opts.max_len = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            opts.ns_per_byte = strtod(optarg, NULL);
+            break;
+        case 'm':
+            opts.mem_per_byte = strtod(optarg, NULL);
+            break;
+        case 'c':
+            opts.cost_per_byte = strtod(optarg, NULL);
+            break;
+        case 'o':
+            opts.corpus = optarg;
+            break;
+        case 'k':
+            opts.max_saved = strtoul(optarg, NULL, 0);
+            break;
+        case 'v':
+            opts.verbose = true;
+            break;
+        case 'h':
+            usage(stdout, argv[0]);
+            return 0;
+        default:
+            usage(stderr, argv[0]);
+            return 2;
+        }
+    }
+
+    if (optind < argc)
+        return replay(argv + optind, argc - optind);
+
+    rng_state = opts.seed ? opts.seed : 1;
+
+    struct buffer buf = { 0 };
+    for (unsigned long i = 0; i < opts.iterations; ++i)
+    {
+        buf.len = 0;
+        buf_putc(&buf, '\0'); // Make sure the buffer is allocated
+        buf.len = 0;
+
+        switch (rng_below(8))
+        {
+        case 0:
+            gen_pathological(&buf);
+            break;
+        case 1:
+        case 2:
+            gen_expr(&buf, rng_below(12));
+            mutate(&buf);
+            break;
+        default:
+            gen_expr(&buf, rng_below(12));
+            break;
+        }
+
+        enum issue issue = check_input(buf.data);
+        if (issue == ISSUE_NONE)
+            continue;
+
+        issue_count[issue] += 1;
+        // Keep every mismatch, but do not flood the corpus with slow inputs
+        if (issue != ISSUE_MISMATCH && issue != ISSUE_EVAL
+            && saved_count[issue] >= opts.max_saved)
+            continue;
+
+        minimize(&buf, issue);
+        if (!save_input(&buf, issue))
+            continue; // Same shape as a previous finding
+
+        saved_count[issue] += 1;
+        if (opts.verbose || issue == ISSUE_MISMATCH || issue == ISSUE_EVAL)
+            printf("%s: '%.80s'%s\n", issue_names[issue], buf.data,
+                   buf.len > 80 ? "..." : "");
+    }
+    free(buf.data);
+
+    bool failed = false;
+    printf("%lu inputs checked\n", opts.iterations);
+    for (size_t i = ISSUE_NONE + 1; i < ARR_SIZE(issue_names); ++i)
+    {
+        printf("%s: %lu, %lu new\n", issue_names[i], issue_count[i],
+               saved_count[i]);
+        if (i == ISSUE_MISMATCH || i == ISSUE_EVAL)
+            failed |= issue_count[i] != 0;
+    }
+
+    return failed;
+}
+
+#endif /* FUZZ_LIBFUZZER */
@@ -0,0 +1,149 @@
+#include <criterion/criterion.h>
+
+#include "ast/ast.h"
+#include "eval/eval.h"
+#include "parse/parse.h"
+
+#define NB_THREADS 4
+
+static struct eval_pool *pool = NULL;
+
+static void setup(void)
+{
+    // Fork on every node to exercise the stealing as much as possible
+    pool = make_eval_pool(NB_THREADS, 1);
+}
+
+static void teardown(void)
+{
+    destroy_eval_pool(pool);
+    pool = NULL;
+}
+
+static void do_success(const char *input, int expected)
+{
+    struct ast_node *ast = climbing_parse(input);
+
+    cr_assert_not_null(ast);
+    cr_expect_eq(pool_eval_ast(pool, ast), expected);
+
+    destroy_ast(ast);
+}
+
+static void do_failure(const char *input)
+{
+    struct ast_node *ast = climbing_parse(input);
+
+    cr_expect_null(ast);
+
+    destroy_ast(ast); // Do not leak if it exists
+}
+
+TestSuite(parallel, .init = setup, .fini = teardown);
+
+#define SUCCESS(Name, Input, Expected) \
+    Test(parallel, Name) { do_success(Input, Expected); }
+#define FAILURE(Name, Input) \
+    Test(parallel, Name) { do_failure(Input); }
+#include "tests.inc"
+
+/*
+ * Build a balanced tree of `2 * depth - 1` nodes, mixing operators
+ */
+static struct ast_node *make_balanced(unsigned depth, unsigned *seed)
+{
+    static const enum op_kind ops[] = { BINOP_PLUS, BINOP_MINUS, BINOP_TIMES };
+
+    *seed = *seed * 1103515245 + 12345;
+    if (depth == 0)
+        return make_num(*seed % 7);
+
+    enum op_kind op = ops[(*seed >> 16) % 3];
+    struct ast_node *lhs = make_balanced(depth - 1, seed);
+    struct ast_node *rhs = make_balanced(depth - 1, seed);
+
+    if ((*seed >> 8) % 5 == 0)
+        rhs = make_unop(UNOP_NEGATE, rhs);
+
+    return make_binop(op, lhs, rhs);
+}
+
+Test(parallel, balanced_tree)
+{
+    unsigned seed = 42;
+    struct ast_node *ast = make_balanced(16, &seed);
+
+    cr_assert_not_null(ast);
+    int expected = eval_ast(ast);
+    for (int i = 0; i < 10; ++i)
+        cr_expect_eq(pool_eval_ast(pool, ast), expected);
+
+    destroy_ast(ast);
+}
+
+Test(parallel, default_cutoff)
+{
+    struct eval_pool *default_pool = make_eval_pool(NB_THREADS, 0);
+    unsigned seed = 1337;
+    struct ast_node *ast = make_balanced(18, &seed);
+
+    cr_assert_not_null(default_pool);
+    cr_assert_not_null(ast);
+    cr_expect_eq(pool_eval_ast(default_pool, ast), eval_ast(ast));
+
+    destroy_ast(ast);
+    destroy_eval_pool(default_pool);
+}
+
+Test(parallel, chain)
+{
+    struct ast_node *ast = make_num(1);
+
+    // Only one side is ever worth forking
+    for (int i = 0; i < 10000; ++i)
+        ast = make_binop(i % 2 ? BINOP_PLUS : BINOP_TIMES, ast, make_num(3));
+
+    cr_assert_not_null(ast);
+    cr_expect_eq(pool_eval_ast(pool, ast), eval_ast(ast));
+
+    destroy_ast(ast);
+}
+
+Test(parallel, long_chain)
+{
+    struct eval_pool *default_pool = make_eval_pool(NB_THREADS, 0);
+    struct ast_node *ast = make_num(1);
+
+    // As deep as it is long, which must not be recursed on
+    for (int i = 0; i < 1000000 && ast; ++i)
+        ast = make_binop(i % 2 ? BINOP_PLUS : BINOP_MINUS, ast, make_num(i));
+
+    cr_assert_not_null(default_pool);
+    cr_assert_not_null(ast);
+    cr_expect_eq(eval_ast(ast), 500001);
+    cr_expect_eq(pool_eval_ast(pool, ast), 500001);
+    cr_expect_eq(pool_eval_ast(default_pool, ast), 500001);
+
+    destroy_ast(ast);
+    destroy_eval_pool(default_pool);
+}
+
+Test(parallel, long_chain_of_subtrees)
+{
+    struct eval_pool *default_pool = make_eval_pool(NB_THREADS, 0);
+    unsigned seed = 7;
+    struct ast_node *ast = make_balanced(12, &seed);
+
+    // Right operands worth forking, all along a long left spine
+    for (int i = 0; i < 300 && ast; ++i)
+        ast = make_binop(BINOP_PLUS, ast, make_balanced(12, &seed));
+
+    cr_assert_not_null(default_pool);
+    cr_assert_not_null(ast);
+    int expected = eval_ast(ast);
+    cr_expect_eq(pool_eval_ast(pool, ast), expected);
+    cr_expect_eq(pool_eval_ast(default_pool, ast), expected);
+
+    destroy_ast(ast);
+    destroy_eval_pool(default_pool);
+}
@@ -0,0 +1,167 @@
+#include <criterion/criterion.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ast/ast.h"
+#include "eval/eval.h"
+#include "opt/opt.h"
+#include "parse/parse.h"
+
+#define NB_THREADS 4
+
+static void do_success(const char *input, int expected)
+{
+    // Split in ranges as small as possible, to exercise the joins
+    struct ast_node *ast = parallel_parse(input, NB_THREADS, 1);
+
+    cr_assert_not_null(ast);
+    cr_expect_eq(eval_ast(ast), expected);
+
+    destroy_ast(ast);
+}
+
+static void do_failure(const char *input)
+{
+    struct ast_node *ast = parallel_parse(input, NB_THREADS, 1);
+
+    cr_expect_null(ast);
+
+    destroy_ast(ast); // Do not leak if it exists
+}
+
+TestSuite(parallel_parse);
+
+#define SUCCESS(Name, Input, Expected) \
+    Test(parallel_parse, Name) { do_success(Input, Expected); }
+#define FAILURE(Name, Input) \
+    Test(parallel_parse, Name) { do_failure(Input); }
+#include "tests.inc"
+
+static bool ast_equal(const struct ast_node *lhs, const struct ast_node *rhs)
+{
+    // Loop on the left operands, as there are as many as terms in a sum
+    for (; lhs && rhs; lhs = lhs->val.bin_op.lhs, rhs = rhs->val.bin_op.lhs)
+    {
+        if (lhs->kind != rhs->kind || lhs->size != rhs->size)
+            return false;
+        if (lhs->kind != NODE_BINOP)
+            break;
+        if (lhs->val.bin_op.op != rhs->val.bin_op.op
+            || !ast_equal(lhs->val.bin_op.rhs, rhs->val.bin_op.rhs))
+            return false;
+    }
+
+    if (lhs == NULL || rhs == NULL)
+        return lhs == rhs;
+
+    switch (lhs->kind)
+    {
+    case NODE_NUM:
+        return lhs->val.num == rhs->val.num;
+    case NODE_VAR:
+        return lhs->val.var == rhs->val.var;
+    case NODE_UNOP:
+        return lhs->val.un_op.op == rhs->val.un_op.op
+               && ast_equal(lhs->val.un_op.tree, rhs->val.un_op.tree);
+    case NODE_BINOP:
+    case NODE_CONSTOP:
+    case NODE_LET:
+        break;
+    }
+
+    return false;
+}
+
+static void do_compare(const char *input)
+{
+    struct ast_node *expected = recursive_parse(input);
+
+    for (unsigned threads = 2; threads <= 8; ++threads)
+    {
+        struct ast_node *ast = parallel_parse(input, threads, 1);
+
+        cr_expect(ast_equal(ast, expected), "%s (%u threads)", input, threads);
+
+        destroy_ast(ast);
+    }
+
+    destroy_ast(expected);
+}
+
+Test(parallel_parse, same_trees)
+{
+    static const char *inputs[] = {
+        "1 + 2 - 3 + 4 - 5",
+        "- 1 - - 2 + + 3",
+        "2 * -3 + 4 ^ -1 - 5! + (6 - 7) - -(8 + 9)",
+        "((1 + 2) - (3 + 4)) - 5 + (6 - (7 - 8))",
+        "1 +   \t  2   -   3",
+        "2 ^ - 3 + 4",
+        "1 + 2 +",
+        "1 + + 2 3",
+        "(1 + 2))+((3",
+        ")1 + 2(",
+        "1 + a + 3",
+        "",
+        "   ",
+    };
+
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(*inputs); ++i)
+        do_compare(inputs[i]);
+}
+
+Test(parallel_parse, large_input)
+{
+    const size_t nb_terms = 100000;
+    char *input = malloc(nb_terms * 16);
+    size_t len = 0;
+
+    cr_assert_not_null(input);
+    for (size_t i = 0; i < nb_terms; ++i)
+        len += sprintf(input + len, "%s(%zu * -%zu)", i % 3 ? " - " : "+",
+                       i % 100, i % 7);
+
+    struct ast_node *expected = recursive_parse(input);
+    struct ast_node *ast = parallel_parse(input, NB_THREADS, 4096);
+
+    cr_assert_not_null(expected);
+    cr_expect(ast_equal(ast, expected));
+    cr_expect_eq(ast_size(ast), 5 * nb_terms);
+
+    destroy_ast(ast);
+    destroy_ast(expected);
+    free(input);
+}
+
+/*
+ * Large enough to be split with the default cutoff, like `evalexpr -j` does,
+ * giving a tree with as many nodes along its left spine as there are terms.
+ */
+Test(parallel_parse, multi_mib_input)
+{
+    const size_t nb_terms = 400000;
+    char *input = malloc(nb_terms * 16);
+    size_t len = 0;
+
+    cr_assert_not_null(input);
+    for (size_t i = 0; i < nb_terms; ++i)
+        len += sprintf(input + len, "%s(%zu * -%zu)", i % 3 ? " - " : "+",
+                       i % 100, i % 7);
+    cr_assert_gt(len, NB_THREADS << 20);
+
+    struct ast_node *expected = recursive_parse(input);
+    struct ast_node *ast = parallel_parse(input, NB_THREADS, 0);
+
+    cr_assert_not_null(expected);
+    cr_expect(ast_equal(ast, expected));
+
+    ast = specialize_ast(ast);
+    cr_assert_not_null(ast);
+    cr_expect_eq(eval_ast(ast), eval_ast(expected));
+
+    destroy_ast(ast);
+    destroy_ast(expected);
+    free(input);
+}
@@ -0,0 +1,381 @@
+#include <criterion/criterion.h>
+
+#include <limits.h>
+#include <stdint.h>
+
+#include "ast/ast.h"
+#include "eval/eval.h"
+#include "opt/opt.h"
+#include "parse/parse.h"
+
+static const char *const names[] = { "x", "y" };
+
+TestSuite(ranges);
+
+static void do_success(const char *input, int expected)
+{
+    struct ast_node *ast = specialize_ast(recursive_parse(input));
+    int res = 0;
+
+    cr_assert_not_null(ast, "%s", input);
+    analyze_ranges(ast, NULL, NULL);
+    cr_expect(safe_eval_ast(ast, &res), "%s", input);
+    cr_expect_eq(res, expected, "%s", input);
+
+    destroy_ast(ast);
+}
+
+static void do_overflow(const char *input)
+{
+    struct ast_node *ast = specialize_ast(recursive_parse(input));
+    int res = 0;
+
+    cr_assert_not_null(ast, "%s", input);
+    analyze_ranges(ast, NULL, NULL);
+    cr_expect_not(safe_eval_ast(ast, &res), "%s", input);
+
+    destroy_ast(ast);
+}
+
+/*
+ * Whether the root of the formula is proven safe, `x` and `y` being bounded
+ */
+static void do_elided(const char *input, struct value_range x,
+                      struct value_range y, bool expected)
+{
+    struct ast_node *ast =
+        specialize_ast(recursive_parse_vars(input, names, 2));
+    const struct value_range vars[] = { x, y };
+    struct range_stats stats = { 0, 0 };
+
+    cr_assert_not_null(ast, "%s", input);
+    analyze_ranges(ast, vars, &stats);
+    cr_expect_eq(ast->safe, expected, "%s", input);
+    cr_expect_leq(stats.nb_elided, stats.nb_checks, "%s", input);
+
+    destroy_ast(ast);
+}
+
+Test(ranges, safe_arithmetic)
+{
+    do_success("2147483646 + 1", INT_MAX);
+    do_success("0 - 2147483647 - 1", INT_MIN);
+    do_success("12!", 479001600);
+    do_success("(-5)!", 1);
+    do_success("46340 ^ 2", 2147395600);
+    do_success("(0 - 2) ^ 31", INT_MIN);
+    do_success("2 ^ -30", 1 << 30);
+    do_success("1 ^ 2147483647", 1);
+    do_success("(0 - 1) ^ 2147483647", -1);
+    do_success("0 ^ 0", 1);
+    do_success("7 / -2", -3);
+    do_success("(0 - 2147483647 - 1) / 1", INT_MIN);
+}
+
+Test(ranges, overflows)
+{
+    do_overflow("2147483647 + 1");
+    do_overflow("0 - 2147483647 - 2");
+    do_overflow("65536 * 32768");
+    do_overflow("-(0 - 2147483647 - 1)");
+    do_overflow("13!");
+    do_overflow("(12 + 1)!");
+    do_overflow("46341 ^ 2");
+    do_overflow("-2 ^ 31");
+    do_overflow("2 ^ 2147483647");
+    do_overflow("1 / 0");
+    do_overflow("1 / (1 - 1)");
+    do_overflow("(0 - 2147483647 - 1) / -1");
+    do_overflow("(0 - 2147483647 - 1) / (0 - 1)");
+    do_overflow("1 + (2147483647 + 1) * 0");
+}
+
+Test(ranges, elided)
+{
+    const struct value_range all = { INT_MIN, INT_MAX };
+    const struct value_range small = { -1000, 1000 };
+    const struct value_range positive = { 1, 100 };
+
+    do_elided("x + y", small, small, true);
+    do_elided("x + y", all, small, false);
+    do_elided("x - y * 3", small, small, true);
+    do_elided("x * y", all, all, false);
+    do_elided("x / y", all, positive, true);
+    do_elided("x / y", all, small, false);
+    do_elided("x / -1", (struct value_range){ INT_MIN + 1, 0 }, all, true);
+    do_elided("x / -1", all, all, false);
+    do_elided("x / 7", all, all, true);
+    do_elided("-x", all, all, false);
+    do_elided("-x", small, all, true);
+    do_elided("x!", (struct value_range){ INT_MIN, 12 }, all, true);
+    do_elided("x!", (struct value_range){ 0, 13 }, all, false);
+    do_elided("x ^ 2", (struct value_range){ -46340, 46340 }, all, true);
+    do_elided("x ^ 2", (struct value_range){ 0, 46341 }, all, false);
+    do_elided("x ^ y", (struct value_range){ -1, 1 }, all, true);
+    do_elided("2 ^ y", all, (struct value_range){ -30, 30 }, true);
+    do_elided("2 ^ y", all, (struct value_range){ 0, 31 }, false);
+    do_elided("(x + y) * (x - y)", small, small, true);
+    do_elided("(x * y) * (x * y)", small, small, false);
+}
+
+Test(ranges, bindings)
+{
+    const char *input = "t = x * y; u = t + 1; u * t";
+    const struct value_range small[] = { { 0, 100 }, { -100, 100 } };
+    const struct value_range big[] = { { 0, 60000 }, { 0, 60000 } };
+    struct range_stats stats = { 0, 0 };
+    struct ast_node *ast = recursive_parse_vars(input, names, 2);
+
+    // Bound variables carry the bounds of their value
+    cr_assert_not_null(ast);
+    analyze_ranges(ast, small, &stats);
+    cr_expect_eq(stats.nb_checks, 3);
+    cr_expect_eq(stats.nb_elided, 3);
+
+    stats.nb_checks = 0;
+    stats.nb_elided = 0;
+    analyze_ranges(ast, big, &stats);
+    cr_expect_eq(stats.nb_checks, 3);
+    cr_expect_eq(stats.nb_elided, 0);
+
+    destroy_ast(ast);
+}
+
+Test(ranges, unbound_variables)
+{
+    const char *inputs[] = { "x + 1", "t = 2; t * 3", "-(y)" };
+
+    // Only `batch_eval` binds them, the other evaluations must not guess
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(*inputs); ++i)
+    {
+        struct ast_node *ast = recursive_parse_vars(inputs[i], names, 2);
+        int res = 0;
+
+        cr_assert_not_null(ast, "%s", inputs[i]);
+        analyze_ranges(ast, NULL, NULL);
+        cr_expect_not(safe_eval_ast(ast, &res), "%s", inputs[i]);
+
+        destroy_ast(ast);
+    }
+}
+
+/*
+ * Exact evaluation, failing as soon as a value does not fit in an `int`.
+ * Operators marked as safe should never fail.
+ */
+static bool ref_eval(const struct ast_node *ast, const int *vals, int64_t *res)
+{
+    enum op_kind op = 0;
+    int64_t lhs = 0;
+    int64_t rhs = 0;
+
+    switch (ast->kind)
+    {
+    case NODE_NUM:
+        *res = ast->val.num;
+        return true;
+    case NODE_VAR:
+        *res = vals[ast->val.var];
+        return true;
+    case NODE_UNOP:
+        op = ast->val.un_op.op;
+        if (!ref_eval(ast->val.un_op.tree, vals, &lhs))
+            return false;
+        break;
+    case NODE_BINOP:
+        op = ast->val.bin_op.op;
+        if (!ref_eval(ast->val.bin_op.lhs, vals, &lhs)
+            || !ref_eval(ast->val.bin_op.rhs, vals, &rhs))
+            return false;
+        break;
+    case NODE_CONSTOP:
+        op = ast->val.const_op.op;
+        rhs = ast->val.const_op.val;
+        if (!ref_eval(ast->val.const_op.tree, vals, &lhs))
+            return false;
+        break;
+    case NODE_LET:
+        cr_assert(false, "unexpected binding");
+        break;
+    }
+
+    bool ok = true;
+    switch (op)
+    {
+    case UNOP_IDENTITY:
+        *res = lhs;
+        break;
+    case UNOP_NEGATE:
+        *res = -lhs;
+        break;
+    case UNOP_FACT:
+        *res = 1;
+        for (int64_t i = 2; ok && i <= lhs; ++i)
+            ok = (*res *= i) <= INT_MAX;
+        break;
+    case BINOP_PLUS:
+        *res = lhs + rhs;
+        break;
+    case BINOP_MINUS:
+        *res = lhs - rhs;
+        break;
+    case BINOP_TIMES:
+        *res = lhs * rhs;
+        break;
+    case BINOP_DIVIDES:
+        ok = rhs != 0;
+        *res = ok ? lhs / rhs : 0;
+        break;
+    case BINOP_POW:
+        *res = 1;
+        for (int64_t i = rhs < 0 ? -rhs : rhs; ok && i > 0; --i)
+        {
+            *res *= lhs;
+            ok = *res >= INT_MIN && *res <= INT_MAX;
+            if (*res == 0 || *res == 1)
+                i = i % 2 ? 1 : 2; // Skip the rest, only the parity matters
+        }
+        break;
+    default:
+        cr_assert(false, "unexpected operator");
+    }
+
+    ok = ok && *res >= INT_MIN && *res <= INT_MAX;
+    cr_assert(ok || !ast->safe, "overflow missed");
+
+    return ok;
+}
+
+static unsigned next(unsigned *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+static const int edges[] = {
+    0, 1, -1, 2, -2, 7, 12, 13, 31, 32, 46340, 46341, 65536,
+    INT_MAX, INT_MIN, INT_MAX - 1, INT_MIN + 1,
+};
+#define NB_EDGES (sizeof(edges) / sizeof(*edges))
+
+static struct ast_node *make_tree(unsigned *seed, int depth)
+{
+    static const enum op_kind unops[] = { UNOP_IDENTITY, UNOP_NEGATE,
+                                          UNOP_FACT };
+    static const enum op_kind binops[] = { BINOP_PLUS, BINOP_MINUS,
+                                           BINOP_TIMES, BINOP_DIVIDES,
+                                           BINOP_POW };
+
+    unsigned kind = depth == 0 ? next(seed) % 2 : next(seed) % 6;
+
+    switch (kind)
+    {
+    case 0:
+        return make_var(next(seed) % 2);
+    case 1:
+        if (next(seed) % 2)
+            return make_num(edges[next(seed) % NB_EDGES]);
+        return make_num((int)(next(seed) % 41) - 20);
+    case 2:
+        return make_unop(unops[next(seed) % 3], make_tree(seed, depth - 1));
+    default:
+    {
+        struct ast_node *lhs = make_tree(seed, depth - 1);
+        struct ast_node *rhs = make_tree(seed, depth - 1);
+
+        return make_binop(binops[next(seed) % 5], lhs, rhs);
+    }
+    }
+}
+
+/*
+ * Windows of 16 values starting on the edges, or anywhere
+ */
+static struct value_range make_range(unsigned *seed)
+{
+    struct value_range ret;
+    int64_t min = next(seed) % 2 ? edges[next(seed) % NB_EDGES]
+                                 : (int)(next(seed) % 2001) - 1000;
+
+    if (min > INT_MAX - 15)
+        min = INT_MAX - 15;
+    ret.min = min;
+    ret.max = min + 15;
+
+    return ret;
+}
+
+/*
+ * Over every value of the declared ranges, safe arithmetic with the checks
+ * elided reports exactly the errors of an exact evaluation.
+ */
+Test(ranges, no_overflow_missed)
+{
+    unsigned seed = 42;
+    struct range_stats stats = { 0, 0 };
+
+    for (int i = 0; i < 2000; ++i)
+    {
+        struct ast_node *ast = specialize_ast(make_tree(&seed, 4));
+        const struct value_range vars[] = { make_range(&seed),
+                                            make_range(&seed) };
+
+        cr_assert_not_null(ast);
+        analyze_ranges(ast, vars, &stats);
+
+        // Only batches bind the variables
+        struct batch_eval *batch = make_batch_eval(ast, true);
+        cr_assert_not_null(batch);
+
+        for (int x = 0; x < 16; ++x)
+        {
+            for (int y = 0; y < 16; ++y)
+            {
+                const int vals[] = { vars[0].min + x, vars[1].min + y };
+                const int *columns[] = { &vals[0], &vals[1] };
+                int64_t expected = 0;
+                int res = 0;
+                bool ok = ref_eval(ast, vals, &expected);
+
+                cr_assert_eq(batch_eval(batch, columns, 1, &res), ok,
+                             "tree %d, x = %d, y = %d", i, vals[0], vals[1]);
+                if (ok)
+                    cr_assert_eq(res, expected, "tree %d, x = %d, y = %d", i,
+                                 vals[0], vals[1]);
+            }
+        }
+
+        destroy_batch_eval(batch);
+        destroy_ast(ast);
+    }
+
+    // The analysis should not be trivially conservative either
+    cr_expect_gt(stats.nb_elided, stats.nb_checks / 4);
+}
+
+Test(ranges, long_chain)
+{
+    struct range_stats stats = { 0, 0 };
+    struct ast_node *ast = make_num(0);
+    int res = 0;
+
+    // As deep as it is long, which must not be recursed on
+    for (int i = 0; i < 1000000 && ast; ++i)
+        ast = make_binop(BINOP_PLUS, ast, make_num(2147));
+
+    cr_assert_not_null(ast);
+    analyze_ranges(ast, NULL, &stats);
+    cr_expect_eq(stats.nb_checks, 1000000);
+    cr_expect_eq(stats.nb_elided, 1000000);
+    cr_expect(safe_eval_ast(ast, &res));
+    cr_expect_eq(res, 2147000000);
+
+    // Only the last addition can overflow
+    ast = make_binop(BINOP_PLUS, ast, make_num(483648));
+    cr_assert_not_null(ast);
+    analyze_ranges(ast, NULL, NULL);
+    cr_expect_not(ast->safe);
+    cr_expect_not(safe_eval_ast(ast, &res));
+
+    destroy_ast(ast);
+}
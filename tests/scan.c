@@ -0,0 +1,191 @@
+#include <criterion/criterion.h>
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ast/ast.h"
+#include "eval/eval.h"
+#include "parse/parse.h"
+#include "parse/scan.h"
+
+static const enum scan_kernel all_kernels[] = {
+    SCAN_BYTES, SCAN_SWAR, SCAN_SSE2, SCAN_AVX2,
+};
+
+static enum scan_kernel default_kernel;
+
+static void setup(void)
+{
+    default_kernel = get_scan_kernel();
+}
+
+static void teardown(void)
+{
+    set_scan_kernel(default_kernel);
+}
+
+TestSuite(scan, .init = setup, .fini = teardown);
+
+/*
+ * Runs of all sizes, starting at all offsets from the kernels' alignment, to
+ * test reading the first and last blocks.
+ */
+Test(scan, whitespace_runs)
+{
+    static const char spaces[] = " \t\n\v\f\r";
+    static char buf[256];
+
+    for (size_t k = 0; k < sizeof(all_kernels) / sizeof(*all_kernels); ++k)
+    {
+        if (!set_scan_kernel(all_kernels[k]))
+            continue;
+
+        for (size_t offset = 0; offset < 64; ++offset)
+        {
+            for (size_t len = 0; len < 130; ++len)
+            {
+                for (size_t i = 0; i < len; ++i)
+                    buf[offset + i] = spaces[(i * 7 + offset) % 6];
+                // Bytes close to whitespace, and the end of the string
+                buf[offset + len] = "\x08\x0e\x1f!a\0"[len % 6];
+                buf[offset + len + 1] = ' ';
+                buf[offset + len + 2] = '\0';
+
+                cr_assert_eq(scan_whitespace(buf + offset),
+                             buf + offset + len, "kernel %d", all_kernels[k]);
+            }
+        }
+    }
+}
+
+Test(scan, numbers)
+{
+    static const struct
+    {
+        const char *input;
+        int val;
+        size_t len; // 0 if it should fail
+    } numbers[] = {
+        { "0", 0, 1 },
+        { "7 ", 7, 1 },
+        { "42)", 42, 2 },
+        { "12345678", 12345678, 8 },
+        { "123456789!", 123456789, 9 },
+        { "1234567890", 1234567890, 10 },
+        { "2147483647", INT_MAX, 10 },
+        { "2147483648", 0, 0 },
+        { "4294967296", 0, 0 },
+        { "9999999999", 0, 0 },
+        { "18446744073709551616", 0, 0 },
+        { "0000000000000000000042", 42, 22 },
+        { "000000000000000000000", 0, 21 },
+        { "00000000002147483647/", INT_MAX, 20 },
+        { "00000000002147483648", 0, 0 },
+        { "", 0, 0 },
+        { "a1", 0, 0 },
+        { " 1", 0, 0 },
+        { "/1", 0, 0 },
+        { ":1", 0, 0 },
+    };
+    static char buf[64];
+
+    for (size_t k = 0; k < sizeof(all_kernels) / sizeof(*all_kernels); ++k)
+    {
+        if (!set_scan_kernel(all_kernels[k]))
+            continue;
+
+        for (size_t i = 0; i < sizeof(numbers) / sizeof(*numbers); ++i)
+        {
+            for (size_t offset = 0; offset < 32; ++offset)
+            {
+                const char *input = strcpy(buf + offset, numbers[i].input);
+                int val = -1;
+
+                bool ok = scan_int(&input, &val);
+                cr_assert_eq(ok, numbers[i].len != 0, "%s, kernel %d",
+                             numbers[i].input, all_kernels[k]);
+                cr_assert_eq(input, buf + offset + numbers[i].len);
+                if (ok)
+                    cr_assert_eq(val, numbers[i].val);
+            }
+        }
+    }
+}
+
+Test(scan, all_values)
+{
+    char buf[32];
+
+    for (size_t k = 0; k < sizeof(all_kernels) / sizeof(*all_kernels); ++k)
+    {
+        if (!set_scan_kernel(all_kernels[k]))
+            continue;
+
+        for (long long num = 0; num <= (long long)INT_MAX * 4; num += 65521)
+        {
+            const char *input = buf;
+            int val = -1;
+
+            sprintf(buf, "%lld ", num);
+            cr_assert_eq(scan_int(&input, &val), num <= INT_MAX, "%s", buf);
+            if (num <= INT_MAX)
+                cr_assert_eq(val, num);
+        }
+    }
+}
+
+Test(scan, signed_values)
+{
+    static const struct
+    {
+        const char *input;
+        bool negative;
+        int val;
+        bool ok;
+    } numbers[] = {
+        { "2147483647", false, INT_MAX, true },
+        { "2147483648", false, 0, false },
+        { "2147483647", true, -INT_MAX, true },
+        { "2147483648", true, INT_MIN, true },
+        { "0002147483648", true, INT_MIN, true },
+        { "2147483649", true, 0, false },
+        { "0", true, 0, true },
+    };
+
+    for (size_t i = 0; i < sizeof(numbers) / sizeof(*numbers); ++i)
+    {
+        const char *input = numbers[i].input;
+        int val = -1;
+
+        cr_assert_eq(scan_signed_int(&input, numbers[i].negative, &val),
+                     numbers[i].ok, "%s", numbers[i].input);
+        if (numbers[i].ok)
+            cr_expect_eq(val, numbers[i].val, "%s", numbers[i].input);
+        else
+            cr_expect_eq(input, numbers[i].input);
+    }
+}
+
+Test(scan, parse_with_kernels)
+{
+    static const char input[] =
+        "  \t 00012345678 \n+    ( 2 \t\t\t\t\t\t\t\t\t\t\t\t\t\t\t* 3 )"
+        "                                   - 000000000000000000000000000001";
+
+    for (size_t k = 0; k < sizeof(all_kernels) / sizeof(*all_kernels); ++k)
+    {
+        if (!set_scan_kernel(all_kernels[k]))
+            continue;
+
+        struct ast_node *ast = climbing_parse(input);
+        cr_assert_not_null(ast);
+        cr_expect_eq(eval_ast(ast), 12345683);
+        destroy_ast(ast);
+
+        ast = recursive_parse(input);
+        cr_assert_not_null(ast);
+        cr_expect_eq(eval_ast(ast), 12345683);
+        destroy_ast(ast);
+    }
+}
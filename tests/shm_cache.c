@@ -0,0 +1,374 @@
+#define _GNU_SOURCE // For `unshare`
+
+#include <criterion/criterion.h>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "io/shm_cache.h"
+
+TestSuite(shm_cache);
+
+static struct expr_key make_key(const char *input, unsigned seed)
+{
+    struct expr_key key;
+
+    init_expr_key(&key, seed);
+    hash_expr(&key, input, strlen(input));
+
+    return key;
+}
+
+static bool same_key(const char *lhs, const char *rhs)
+{
+    struct expr_key lhs_key = make_key(lhs, 0);
+    struct expr_key rhs_key = make_key(rhs, 0);
+
+    return memcmp(lhs_key.hash, rhs_key.hash, sizeof(lhs_key.hash)) == 0;
+}
+
+// Each test uses its own segment, removed once done
+static struct shm_cache *open_cache(char *name, const char *test,
+                                    size_t nb_slots)
+{
+    sprintf(name, "/evalexpr-test-%s-%d", test, (int)getpid());
+    shm_unlink(name);
+
+    struct shm_cache *ret = make_shm_cache(name, nb_slots);
+    cr_assert_not_null(ret);
+
+    return ret;
+}
+
+// Key and value of the i-th entry
+static struct expr_key nth_key(int i)
+{
+    char input[32];
+
+    sprintf(input, "%d + 1", i);
+    return make_key(input, 0);
+}
+
+static int nth_value(int i)
+{
+    return i * 7919;
+}
+
+Test(shm_cache, keys)
+{
+    cr_expect(same_key("1 + 2", "1+2"));
+    cr_expect(same_key("\t1+ 2 \n", "1+2"));
+    cr_expect(same_key("(1) ! ", "(1)!"));
+    cr_expect(same_key("1 -2", "1-2"));
+    cr_expect_not(same_key("1 2", "12"));
+    cr_expect_not(same_key("1+2", "1+3"));
+    cr_expect_not(same_key("1+2", "2+1"));
+
+    // Same key when hashed in several parts
+    struct expr_key whole = make_key("12 + 34 5", 0);
+    struct expr_key parts;
+    init_expr_key(&parts, 0);
+    hash_expr(&parts, "12 ", 3);
+    hash_expr(&parts, "+ 3", 3);
+    hash_expr(&parts, "4 ", 2);
+    hash_expr(&parts, "5", 1);
+    cr_expect_eq(memcmp(whole.hash, parts.hash, sizeof(whole.hash)), 0);
+
+    // Seeds separate the modes of evaluation
+    struct expr_key seeded = make_key("12 + 34 5", 1);
+    cr_expect_neq(memcmp(whole.hash, seeded.hash, sizeof(whole.hash)), 0);
+}
+
+Test(shm_cache, insert_lookup)
+{
+    char name[64];
+    struct shm_cache *cache = open_cache(name, "lookup", 1024);
+    struct cache_stats local;
+    struct cache_stats shared;
+    int res = 0;
+
+    for (int i = 0; i < 100; ++i)
+    {
+        struct expr_key key = nth_key(i);
+
+        cr_expect_not(shm_cache_lookup(cache, &key, &res));
+        shm_cache_insert(cache, &key, nth_value(i));
+    }
+
+    for (int i = 0; i < 100; ++i)
+    {
+        struct expr_key key = nth_key(i);
+
+        cr_assert(shm_cache_lookup(cache, &key, &res), "%d", i);
+        cr_expect_eq(res, nth_value(i));
+    }
+
+    // Inserting it again changes nothing
+    struct expr_key key = nth_key(0);
+    shm_cache_insert(cache, &key, 42);
+    cr_assert(shm_cache_lookup(cache, &key, &res));
+    cr_expect_eq(res, nth_value(0));
+
+    shm_cache_stats(cache, &local, &shared);
+    cr_expect_eq(local.hits, 101);
+    cr_expect_eq(local.misses, 100);
+    cr_expect_eq(local.inserts, 100);
+    cr_expect_eq(shared.hits, 101);
+
+    destroy_shm_cache(cache);
+    shm_unlink(name);
+}
+
+Test(shm_cache, shared)
+{
+    char name[64];
+    struct shm_cache *cache = open_cache(name, "shared", 1024);
+    struct expr_key key = nth_key(1);
+    struct cache_stats local;
+    struct cache_stats shared;
+    int status = 0;
+    int res = 0;
+
+    pid_t pid = fork();
+    cr_assert_geq(pid, 0);
+    if (pid == 0)
+    {
+        struct shm_cache *child = make_shm_cache(name, 0);
+
+        if (child == NULL)
+            _exit(1);
+        shm_cache_insert(child, &key, 42);
+        destroy_shm_cache(child);
+        _exit(0);
+    }
+
+    cr_assert_eq(waitpid(pid, &status, 0), pid);
+    cr_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    cr_assert(shm_cache_lookup(cache, &key, &res));
+    cr_expect_eq(res, 42);
+
+    shm_cache_stats(cache, &local, &shared);
+    cr_expect_eq(local.inserts, 0);
+    cr_expect_eq(shared.inserts, 1);
+
+    destroy_shm_cache(cache);
+    shm_unlink(name);
+}
+
+/*
+ * The table never grows: older entries are evicted, and lookups either miss
+ * or give the right value.
+ */
+Test(shm_cache, eviction)
+{
+    char name[64];
+    struct shm_cache *cache = open_cache(name, "eviction", 8);
+    struct cache_stats local;
+    struct cache_stats shared;
+    int res = 0;
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        struct expr_key key = nth_key(i);
+
+        shm_cache_insert(cache, &key, nth_value(i));
+        cr_assert(shm_cache_lookup(cache, &key, &res), "%d", i);
+        cr_assert_eq(res, nth_value(i));
+    }
+
+    size_t nb_hits = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        struct expr_key key = nth_key(i);
+
+        if (!shm_cache_lookup(cache, &key, &res))
+            continue;
+        cr_assert_eq(res, nth_value(i), "%d", i);
+        nb_hits += 1;
+    }
+
+    cr_expect_leq(nb_hits, 8);
+    shm_cache_stats(cache, &local, &shared);
+    cr_expect_geq(local.evictions, 1000 - 8);
+
+    destroy_shm_cache(cache);
+    shm_unlink(name);
+}
+
+/*
+ * Processes killed in the middle of inserting entries never leave wrong
+ * values behind, nor make the cache unusable.
+ */
+Test(shm_cache, killed_writers)
+{
+    char name[64];
+    struct shm_cache *cache = open_cache(name, "killed", 64);
+    int res = 0;
+
+    for (int round = 0; round < 10; ++round)
+    {
+        pid_t pid = fork();
+
+        cr_assert_geq(pid, 0);
+        if (pid == 0)
+        {
+            struct shm_cache *child = make_shm_cache(name, 0);
+
+            for (int i = 0; child; i = (i + 1) % 1000)
+            {
+                struct expr_key key = nth_key(i);
+                shm_cache_insert(child, &key, nth_value(i));
+            }
+            _exit(1);
+        }
+
+        struct timespec ts = { 0, 1000000 * (round + 1) };
+        nanosleep(&ts, NULL);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+    }
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        struct expr_key key = nth_key(i);
+
+        if (shm_cache_lookup(cache, &key, &res))
+            cr_assert_eq(res, nth_value(i), "%d", i);
+    }
+
+    // Every entry can be inserted again
+    for (int i = 0; i < 1000; ++i)
+    {
+        struct expr_key key = nth_key(-i);
+
+        shm_cache_insert(cache, &key, nth_value(-i));
+        cr_assert(shm_cache_lookup(cache, &key, &res), "%d", i);
+        cr_assert_eq(res, nth_value(-i));
+    }
+
+    destroy_shm_cache(cache);
+    shm_unlink(name);
+}
+
+/*
+ * Segments created by processes which died before initializing them, or
+ * before setting their size, are replaced.
+ */
+Test(shm_cache, invalid_segment)
+{
+    char name[64];
+    const off_t sizes[] = { 4096, 0 };
+
+    sprintf(name, "/evalexpr-test-invalid-%d", (int)getpid());
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i)
+    {
+        struct expr_key key = nth_key(i);
+        int res = 0;
+
+        shm_unlink(name);
+        int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+        cr_assert_geq(fd, 0);
+        cr_assert_eq(ftruncate(fd, sizes[i]), 0);
+        close(fd);
+
+        struct shm_cache *cache = make_shm_cache(name, 0);
+        cr_assert_not_null(cache, "%zu", i);
+        shm_cache_insert(cache, &key, nth_value(i));
+        destroy_shm_cache(cache);
+
+        // The new segment is the one other processes open
+        cache = make_shm_cache(name, 0);
+        cr_assert_not_null(cache, "%zu", i);
+        cr_expect(shm_cache_lookup(cache, &key, &res), "%zu", i);
+        cr_expect_eq(res, nth_value(i), "%zu", i);
+        destroy_shm_cache(cache);
+    }
+
+    shm_unlink(name);
+}
+
+/*
+ * Writers of another PID namespace are never taken for dead, even if their
+ * PID does not exist in the namespace of the test. Creating the namespace
+ * needs privileges, the test does nothing without them.
+ */
+Test(shm_cache, foreign_writers)
+{
+    char name[64];
+    struct shm_cache *cache = open_cache(name, "foreign", 64);
+    struct cache_stats local;
+    struct cache_stats shared;
+    int fds[2];
+    char ready = 0;
+
+    cr_assert_eq(pipe(fds), 0);
+
+    pid_t pid = fork();
+    cr_assert_geq(pid, 0);
+    if (pid == 0)
+    {
+        // The first child is the init of the namespace, the writer is 2
+        close(fds[0]);
+        setpgid(0, 0);
+        if (unshare(CLONE_NEWPID) < 0 || fork() != 0)
+            _exit(wait(NULL) < 0);
+        if (fork() != 0)
+            _exit(wait(NULL) < 0);
+
+        struct shm_cache *child = make_shm_cache(name, 0);
+        if (child == NULL || write(fds[1], "", 1) != 1)
+            _exit(1);
+        for (int i = 0;; i = (i + 1) % 1000)
+        {
+            struct expr_key key = nth_key(i);
+            shm_cache_insert(child, &key, nth_value(i));
+        }
+    }
+
+    close(fds[1]);
+    if (read(fds[0], &ready, 1) == 1)
+    {
+        for (int round = 0; round < 50; ++round)
+        {
+            struct timespec ts = { 0, 100000 * (round + 1) };
+            nanosleep(&ts, NULL);
+
+            // Stopped in the middle of an insertion, at times
+            kill(-pid, SIGSTOP);
+            for (int i = 0; i < 1000; ++i)
+            {
+                struct expr_key key = nth_key(-i);
+                shm_cache_insert(cache, &key, nth_value(-i));
+            }
+            kill(-pid, SIGCONT);
+        }
+        kill(-pid, SIGKILL);
+    }
+
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+
+    shm_cache_stats(cache, &local, &shared);
+    cr_expect_eq(shared.reclaims, 0);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        struct expr_key key = nth_key(i);
+        int res = 0;
+
+        if (shm_cache_lookup(cache, &key, &res))
+            cr_assert_eq(res, nth_value(i), "%d", i);
+    }
+
+    destroy_shm_cache(cache);
+    shm_unlink(name);
+}
@@ -0,0 +1,149 @@
+#include <criterion/criterion.h>
+
+#include <limits.h>
+#include <stdio.h>
+
+#include "ast/ast.h"
+#include "eval/eval.h"
+#include "opt/opt.h"
+#include "parse/parse.h"
+
+static void do_success(const char *input, int expected)
+{
+    struct ast_node *ast = specialize_ast(climbing_parse(input));
+
+    cr_assert_not_null(ast);
+    cr_expect_eq(eval_ast(ast), expected);
+
+    destroy_ast(ast);
+}
+
+static void do_failure(const char *input)
+{
+    struct ast_node *ast = specialize_ast(climbing_parse(input));
+
+    cr_expect_null(ast);
+
+    destroy_ast(ast); // Do not leak if it exists
+}
+
+TestSuite(specialize);
+
+#define SUCCESS(Name, Input, Expected) \
+    Test(specialize, Name) { do_success(Input, Expected); }
+#define FAILURE(Name, Input) \
+    Test(specialize, Name) { do_failure(Input); }
+#include "tests.inc"
+
+/*
+ * Compare the specialized and original trees on `lhs <op> rhs`
+ */
+static void do_compare(enum op_kind op, int lhs, int rhs)
+{
+    struct ast_node *ast = make_binop(op, make_num(lhs), make_num(rhs));
+    int expected = eval_ast(ast);
+
+    ast = specialize_ast(ast);
+    cr_assert_not_null(ast);
+    cr_expect_eq(eval_ast(ast), expected, "%d %d", lhs, rhs);
+
+    destroy_ast(ast);
+}
+
+static const int numerators[] = {
+    INT_MIN, INT_MIN + 1, INT_MIN + 2, -1000000007, -65536, -65535, -1001,
+    -1000, -999, -10, -7, -3, -2, -1, 0, 1, 2, 3, 7, 10, 999, 1000, 1001,
+    65535, 65536, 1000000007, INT_MAX - 2, INT_MAX - 1, INT_MAX,
+};
+
+Test(specialize, constant_divisors)
+{
+    static const int divisors[] = {
+        INT_MIN, INT_MIN + 1, -1000000007, -65536, -641, -7, -3, -2, 1, 2, 3,
+        5, 6, 7, 10, 11, 25, 125, 641, 65536, 1000000007, INT_MAX - 1, INT_MAX,
+    };
+
+    for (size_t i = 0; i < sizeof(numerators) / sizeof(*numerators); ++i)
+        for (size_t j = 0; j < sizeof(divisors) / sizeof(*divisors); ++j)
+            do_compare(BINOP_DIVIDES, numerators[i], divisors[j]);
+
+    for (int num = -3000; num <= 3000; num += 7)
+        for (int div = -300; div <= 300; ++div)
+            if (div != 0 && div != -1)
+                do_compare(BINOP_DIVIDES, num, div);
+}
+
+Test(specialize, constant_exponents)
+{
+    static const int exponents[] = {
+        INT_MIN, -1000000007, -31, -16, -3, -2, -1, 0, 1, 2, 3, 4, 5, 16, 31,
+        32, 33, 1000000007, INT_MAX,
+    };
+
+    for (size_t i = 0; i < sizeof(numerators) / sizeof(*numerators); ++i)
+        for (size_t j = 0; j < sizeof(exponents) / sizeof(*exponents); ++j)
+            do_compare(BINOP_POW, numerators[i], exponents[j]);
+}
+
+Test(specialize, factorial_table)
+{
+    for (int num = -3; num <= 40; ++num)
+    {
+        char input[32];
+        sprintf(input, "(0 + %d)! + %d!", num, num < 0 ? 0 : num);
+
+        struct ast_node *ast = climbing_parse(input);
+        cr_assert_not_null(ast);
+        int expected = eval_ast(ast);
+
+        ast = specialize_ast(ast);
+        cr_assert_not_null(ast);
+        cr_expect_eq(eval_ast(ast), expected, "%d", num);
+
+        destroy_ast(ast);
+    }
+}
+
+Test(specialize, rewrites)
+{
+    struct ast_node *ast = specialize_ast(climbing_parse("(1 + 2) / -3"));
+
+    cr_assert_not_null(ast);
+    cr_expect_eq(ast->kind, NODE_CONSTOP);
+    cr_expect_eq(eval_ast(ast), -1);
+    destroy_ast(ast);
+
+    ast = specialize_ast(climbing_parse("5!"));
+
+    cr_assert_not_null(ast);
+    cr_expect_eq(ast->kind, NODE_NUM);
+    cr_expect_eq(ast->val.num, 120);
+    destroy_ast(ast);
+
+    ast = specialize_ast(climbing_parse("(1 + 2) ^ 1"));
+
+    cr_assert_not_null(ast);
+    cr_expect_eq(ast->kind, NODE_BINOP);
+    cr_expect_eq(eval_ast(ast), 3);
+    destroy_ast(ast);
+}
+
+Test(specialize, long_chain)
+{
+    struct ast_node *ast = make_num(1);
+
+    // As deep as it is long, which must not be recursed on
+    for (int i = 0; i < 1000000 && ast; ++i)
+        ast = make_binop(i % 2 ? BINOP_DIVIDES : BINOP_PLUS, ast,
+                         make_num(i % 2 ? 1 : 2));
+
+    cr_assert_not_null(ast);
+    ast = specialize_ast(ast);
+    cr_assert_not_null(ast);
+
+    // Divisions by 1 are removed, leaving one node per addition
+    cr_expect_eq(ast_size(ast), 1000001);
+    cr_expect_eq(eval_ast(ast), 1000001);
+
+    destroy_ast(ast);
+}
@@ -0,0 +1,168 @@
+#include <criterion/criterion.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ast/ast.h"
+#include "eval/eval.h"
+#include "parse/parse.h"
+
+static struct ast_node *parse_chunks(const char *input, size_t chunk)
+{
+    struct stream_parser *parser = make_stream_parser();
+    size_t len = strlen(input);
+
+    cr_assert_not_null(parser);
+
+    for (size_t i = 0; i < len; i += chunk)
+    {
+        size_t size = len - i < chunk ? len - i : chunk;
+        if (!stream_parse(parser, input + i, size))
+            break; // Parsing errors are reported when finishing
+    }
+
+    return finish_stream_parser(parser);
+}
+
+static void do_success(const char *input, int expected)
+{
+    // Split numbers and operators at every possible position
+    for (size_t chunk = 1; chunk <= 3; ++chunk)
+    {
+        struct ast_node *ast = parse_chunks(input, chunk);
+
+        cr_assert_not_null(ast);
+        cr_expect_eq(eval_ast(ast), expected);
+
+        destroy_ast(ast);
+    }
+
+    struct ast_node *ast = parse_chunks(input, strlen(input) + 1);
+
+    cr_assert_not_null(ast);
+    cr_expect_eq(eval_ast(ast), expected);
+
+    destroy_ast(ast);
+}
+
+static void do_failure(const char *input)
+{
+    for (size_t chunk = 1; chunk <= strlen(input) + 1; ++chunk)
+    {
+        struct ast_node *ast = parse_chunks(input, chunk);
+
+        cr_expect_null(ast);
+
+        destroy_ast(ast); // Do not leak if it exists
+    }
+}
+
+TestSuite(stream);
+
+#define SUCCESS(Name, Input, Expected) \
+    Test(stream, Name) { do_success(Input, Expected); }
+#define FAILURE(Name, Input) \
+    Test(stream, Name) { do_failure(Input); }
+#include "tests.inc"
+
+Test(stream, abandon)
+{
+    struct stream_parser *parser = make_stream_parser();
+
+    cr_assert_not_null(parser);
+    cr_expect(stream_parse(parser, "(1 + 2", 6));
+
+    destroy_stream_parser(parser); // Do not leak the partial tree
+}
+
+Test(stream, error_is_sticky)
+{
+    struct stream_parser *parser = make_stream_parser();
+
+    cr_assert_not_null(parser);
+    cr_expect_not(stream_parse(parser, "1 )", 3));
+    cr_expect_not(stream_parse(parser, "+ 1", 3));
+    cr_expect_null(finish_stream_parser(parser));
+}
+
+Test(stream, high_bytes)
+{
+    // Neither whitespace nor digits, whatever the locale says
+    static const char *const inputs[] = { "1 +\xa0 2", "1\xb2", "\x85 1" };
+
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(*inputs); ++i)
+    {
+        do_failure(inputs[i]);
+        cr_expect_null(recursive_parse(inputs[i]));
+    }
+}
+
+/*
+ * Run `./evalexpr` with the given arguments on the input file, returning the
+ * first line of its output.
+ */
+static void run_evalexpr(char *const argv[], FILE *input, char *out,
+                         size_t size)
+{
+    int fds[2];
+    int status = 0;
+    ssize_t len = 0;
+
+    cr_assert_eq(access(argv[0], X_OK), 0, "run `make` first");
+    cr_assert_eq(pipe(fds), 0);
+    rewind(input);
+
+    pid_t pid = fork();
+    cr_assert_geq(pid, 0);
+    if (pid == 0)
+    {
+        dup2(fileno(input), STDIN_FILENO);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    close(fds[1]);
+    for (ssize_t res = 1; res > 0 && (size_t)len < size - 1; len += res)
+        res = read(fds[0], out + len, size - 1 - len);
+    close(fds[0]);
+    out[len > 0 ? len : 0] = '\0';
+
+    cr_assert_eq(waitpid(pid, &status, 0), pid);
+    cr_expect(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+/*
+ * A single line of 12 MB, read in chunks by the streaming modes, and whose
+ * tree is as deep as it has terms.
+ */
+Test(stream, cli_single_line)
+{
+    static char *const modes[][4] = {
+        { "./evalexpr", "-s", NULL, NULL },
+        { "./evalexpr", "-a", "auto", NULL },
+        { "./evalexpr", NULL, NULL, NULL },
+        { "./evalexpr", "-j", "4", NULL },
+    };
+    const size_t nb_terms = 1 << 21;
+    FILE *input = tmpfile();
+    char out[64];
+
+    cr_assert_not_null(input);
+    for (size_t i = 0; i < nb_terms; ++i)
+        fputs(i % 2 ? "-99998" : "+99999", input);
+    fputc('\n', input);
+    cr_assert_eq(fflush(input), 0);
+
+    for (size_t i = 0; i < sizeof(modes) / sizeof(*modes); ++i)
+    {
+        run_evalexpr(modes[i], input, out, sizeof(out));
+        cr_expect_str_eq(out, "1048576\n", "mode %zu", i);
+    }
+
+    fclose(input);
+}